@@ -5,13 +5,50 @@
 #define DEBUG_FLAG XAPP_DEBUG_FAVORITE_VFS
 #include "xapp-debug.h"
 
+typedef struct _UriTrieNode UriTrieNode;
+
+/* All favorites:/// directory monitors in the process share a single hub. It
+ * listens to XAppFavorites and the volume monitor once, keeps the only copy of
+ * the favorites list, computes each diff once and fans the resulting events out
+ * to every live monitor. */
 typedef struct
 {
+    gint ref_count;
+
     gulong changed_handler_id;
     GHashTable *file_monitors;
-    GList *infos;
+    GHashTable *infos; // uri -> XAppFavoriteInfo
+    UriTrieNode *trie;
 
     GVolumeMonitor *mount_mon;
+
+    GList *monitors; // FavoriteVfsFileMonitor - not owned
+
+    GHashTable *pending; // favorites uri -> PendingEvent
+    guint flush_id;
+    gint64 last_flush_time;
+} FavoriteMonitorHub;
+
+/* Changes are coalesced per favorites:// file and delivered in batches, at
+ * most once per EVENT_RATE_LIMIT_MS, so bulk edits of the favorites list
+ * don't flood file managers with individual events. */
+typedef struct
+{
+    GFile *file;
+    GFileMonitorEvent event_type;
+} PendingEvent;
+
+#define EVENT_RATE_LIMIT_MS 200
+
+static FavoriteMonitorHub *monitor_hub = NULL;
+G_LOCK_DEFINE_STATIC (monitor_hub);
+
+static FavoriteMonitorHub *hub_ref   (FavoriteMonitorHub *hub);
+static void                hub_unref (FavoriteMonitorHub *hub);
+
+typedef struct
+{
+    FavoriteMonitorHub *hub;
 } FavoriteVfsFileMonitorPrivate;
 
 struct _FavoriteVfsFileMonitor
@@ -53,9 +90,7 @@ favorite_real_file_changed (GFileMonitor     *rfmonitor,
     // Disabled
     return;
 
-//     g_return_if_fail (FAVORITE_IS_VFS_FILE_MONITOR (user_data));
-//     FavoriteVfsFileMonitor *monitor = FAVORITE_VFS_FILE_MONITOR (user_data);
-//     FavoriteVfsFileMonitorPrivate *priv = favorite_vfs_file_monitor_get_instance_private (monitor);
+//     FavoriteMonitorHub *hub = (FavoriteMonitorHub *) user_data;
 
 //     DEBUG ("real file changed: %s: %d", g_file_get_uri (file), event_type);
 
@@ -90,7 +125,7 @@ favorite_real_file_changed (GFileMonitor     *rfmonitor,
 
 //                 GList *iter;
 
-//                 for (iter = priv->infos; iter != NULL; iter = iter->next)
+//                 for (iter = hub->infos; iter != NULL; iter = iter->next)
 //                 {
 //                     XAppFavoriteInfo *info = (XAppFavoriteInfo *) iter->data;
 
@@ -105,14 +140,8 @@ favorite_real_file_changed (GFileMonitor     *rfmonitor,
 //                         DEBUG ("Changed: %s", uri);
 //                         g_free (uri);
 
-//                         g_file_monitor_emit_event (G_FILE_MONITOR (monitor),
-//                                                    fav_file,
-//                                                    NULL,
-//                                                    G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED);
-//                         g_file_monitor_emit_event (G_FILE_MONITOR (monitor),
-//                                                    fav_file,
-//                                                    NULL,
-//                                                    G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT);
+//                         hub_emit_event (hub, fav_file, G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED);
+//                         hub_emit_event (hub, fav_file, G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT);
 //                         g_object_unref (fav_file);
 
 //                         break;
@@ -135,37 +164,65 @@ favorite_real_file_changed (GFileMonitor     *rfmonitor,
 }
 
 static void
-unmonitor_files (FavoriteVfsFileMonitor *monitor)
+hub_emit_event (FavoriteMonitorHub *hub,
+                GFile              *file,
+                GFileMonitorEvent   event_type)
+{
+    GList *monitors, *iter;
+
+    // Handlers may drop the last reference to a monitor, so work on a copy.
+    G_LOCK (monitor_hub);
+    monitors = g_list_copy_deep (hub->monitors, (GCopyFunc) g_object_ref, NULL);
+    G_UNLOCK (monitor_hub);
+
+    for (iter = monitors; iter != NULL; iter = iter->next)
+    {
+        GFileMonitor *monitor = G_FILE_MONITOR (iter->data);
+
+        if (g_file_monitor_is_cancelled (monitor))
+        {
+            continue;
+        }
+
+        g_file_monitor_emit_event (monitor,
+                                   file,
+                                   NULL,
+                                   event_type);
+    }
+
+    g_list_free_full (monitors, g_object_unref);
+}
+
+static void
+unmonitor_files (FavoriteMonitorHub *hub)
 {
     /* Disabled. See below */
     return;
 
-    FavoriteVfsFileMonitorPrivate *priv = favorite_vfs_file_monitor_get_instance_private (monitor);
-
-    if (priv->file_monitors != NULL)
+    if (hub->file_monitors != NULL)
     {
-        g_hash_table_destroy (priv->file_monitors);
-        priv->file_monitors = NULL;
+        g_hash_table_destroy (hub->file_monitors);
+        hub->file_monitors = NULL;
     }
 }
 
 static void
-monitor_files (FavoriteVfsFileMonitor *monitor)
+monitor_files (FavoriteMonitorHub *hub)
 {
 
     /* Disabled - this isn't necessary right now but could be expanded to help
      * support less integrated apps. */
     return;
 
-    FavoriteVfsFileMonitorPrivate *priv = favorite_vfs_file_monitor_get_instance_private (monitor);
-    GList *iter;
+    GHashTableIter iter;
+    XAppFavoriteInfo *info;
 
-    priv->file_monitors = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                 g_free, (GDestroyNotify) g_object_unref);
+    hub->file_monitors = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                g_free, (GDestroyNotify) g_object_unref);
 
-    for (iter = priv->infos; iter != NULL; iter = iter->next)
+    g_hash_table_iter_init (&iter, hub->infos);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &info))
     {
-        XAppFavoriteInfo *info = (XAppFavoriteInfo *) iter->data;
         GFileMonitor *real_monitor;
         GFile *real_file;
         GError *error;
@@ -191,118 +248,431 @@ monitor_files (FavoriteVfsFileMonitor *monitor)
             continue;
         }
 
-        g_hash_table_insert (priv->file_monitors,
+        g_hash_table_insert (hub->file_monitors,
                              (gpointer) g_strdup (info->uri),
                              (gpointer) real_monitor);
 
         g_signal_connect (real_monitor,
                           "changed",
                           G_CALLBACK (favorite_real_file_changed),
-                          monitor);
+                          hub);
+    }
+}
+
+/* Favorite uris indexed by path segment, so a mount event only has to visit
+ * the favorites that live below the mount root. */
+struct _UriTrieNode
+{
+    GHashTable *children; // path segment -> UriTrieNode, created on demand
+    GSList *uris;         // favorite uris (keys of FavoriteMonitorHub.infos) ending here
+};
+
+static UriTrieNode *
+uri_trie_node_new (void)
+{
+    return g_slice_new0 (UriTrieNode);
+}
+
+static void
+uri_trie_node_free (UriTrieNode *node)
+{
+    if (node->children != NULL)
+    {
+        g_hash_table_destroy (node->children);
     }
+
+    g_slist_free_full (node->uris, g_free);
+    g_slice_free (UriTrieNode, node);
 }
 
-static gint
-find_info_by_uri (gconstpointer ptr_a,
-                  gconstpointer ptr_b)
+static gchar **
+get_uri_segments (GFile *file)
 {
-    XAppFavoriteInfo *info = (XAppFavoriteInfo *) ptr_a;
-    const gchar *uri = (gchar *) ptr_b;
+    gchar *uri;
+    gchar **segments;
+    gint i, j;
+
+    // Let GFile normalize the uri, so it compares with what g_mount_get_root() gives us.
+    uri = g_file_get_uri (file);
+    segments = g_strsplit (uri, "/", -1);
+    g_free (uri);
+
+    for (i = 0, j = 0; segments[i] != NULL; i++)
+    {
+        if (segments[i][0] == '\0')
+        {
+            g_free (segments[i]);
+            continue;
+        }
+
+        segments[j++] = segments[i];
+    }
+
+    segments[j] = NULL;
 
-    // GCompareFunc returns 0 when there's a match.
-    return g_strcmp0 (info->uri, uri);
+    return segments;
 }
 
 static void
-favorites_changed (XAppFavorites *favorites,
-                   gpointer       user_data)
+uri_trie_insert (UriTrieNode *root,
+                 const gchar *uri)
 {
-    g_return_if_fail (XAPP_IS_FAVORITES (favorites));
-    g_return_if_fail (FAVORITE_IS_VFS_FILE_MONITOR (user_data));
+    UriTrieNode *node;
+    GFile *file;
+    gchar **segments;
+    gint i;
 
-    FavoriteVfsFileMonitor *monitor = FAVORITE_VFS_FILE_MONITOR (user_data);
-    FavoriteVfsFileMonitorPrivate *priv = favorite_vfs_file_monitor_get_instance_private (monitor);
-    GList *added, *removed;
-    GList *iter, *new_infos;
+    file = g_file_new_for_uri (uri);
+    segments = get_uri_segments (file);
+    g_object_unref (file);
+
+    node = root;
+
+    for (i = 0; segments[i] != NULL; i++)
+    {
+        UriTrieNode *child = NULL;
+
+        if (node->children == NULL)
+        {
+            node->children = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                    g_free, (GDestroyNotify) uri_trie_node_free);
+        }
+        else
+        {
+            child = g_hash_table_lookup (node->children, segments[i]);
+        }
+
+        if (child == NULL)
+        {
+            child = uri_trie_node_new ();
+            g_hash_table_insert (node->children, g_strdup (segments[i]), child);
+        }
+
+        node = child;
+    }
+
+    node->uris = g_slist_prepend (node->uris, g_strdup (uri));
+
+    g_strfreev (segments);
+}
+
+// Returns TRUE if the node is left empty and can be pruned.
+static gboolean
+uri_trie_remove_segments (UriTrieNode  *node,
+                          gchar       **segments,
+                          const gchar  *uri)
+{
+    if (segments[0] == NULL)
+    {
+        GSList *link = g_slist_find_custom (node->uris, uri, (GCompareFunc) g_strcmp0);
+
+        if (link != NULL)
+        {
+            g_free (link->data);
+            node->uris = g_slist_delete_link (node->uris, link);
+        }
+    }
+    else
+    if (node->children != NULL)
+    {
+        UriTrieNode *child = g_hash_table_lookup (node->children, segments[0]);
+
+        if (child != NULL && uri_trie_remove_segments (child, segments + 1, uri))
+        {
+            g_hash_table_remove (node->children, segments[0]);
+        }
+    }
+
+    return node->uris == NULL && (node->children == NULL || g_hash_table_size (node->children) == 0);
+}
+
+static void
+uri_trie_remove (UriTrieNode *root,
+                 const gchar *uri)
+{
+    GFile *file;
+    gchar **segments;
+
+    file = g_file_new_for_uri (uri);
+    segments = get_uri_segments (file);
+    g_object_unref (file);
+
+    uri_trie_remove_segments (root, segments, uri);
+
+    g_strfreev (segments);
+}
+
+static void
+uri_trie_collect_descendants (UriTrieNode  *node,
+                              GSList      **uris)
+{
+    GHashTableIter iter;
+    UriTrieNode *child;
 
-    if (g_file_monitor_is_cancelled (G_FILE_MONITOR (monitor)))
+    if (node->children == NULL)
     {
         return;
     }
 
-    added = removed = NULL;
+    g_hash_table_iter_init (&iter, node->children);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &child))
+    {
+        GSList *l;
+
+        for (l = child->uris; l != NULL; l = l->next)
+        {
+            *uris = g_slist_prepend (*uris, l->data);
+        }
+
+        uri_trie_collect_descendants (child, uris);
+    }
+}
+
+// Returns the uris (owned by the trie) of all favorites strictly below parent.
+static GSList *
+uri_trie_find_descendants (UriTrieNode *root,
+                           GFile       *parent)
+{
+    UriTrieNode *node;
+    GSList *uris;
+    gchar **segments;
+    gint i;
+
+    segments = get_uri_segments (parent);
+    node = root;
+
+    for (i = 0; segments[i] != NULL && node != NULL; i++)
+    {
+        node = node->children != NULL ? g_hash_table_lookup (node->children, segments[i]) : NULL;
+    }
+
+    g_strfreev (segments);
+
+    uris = NULL;
+
+    if (node != NULL)
+    {
+        uri_trie_collect_descendants (node, &uris);
+    }
+
+    return uris;
+}
+
+static GHashTable *
+infos_table_new (GList *infos)
+{
+    GHashTable *table;
+    GList *iter;
+
+    // Keyed by the info's own uri, the table owns the infos.
+    table = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                   NULL, (GDestroyNotify) xapp_favorite_info_free);
+
+    for (iter = infos; iter != NULL; iter = iter->next)
+    {
+        XAppFavoriteInfo *info = (XAppFavoriteInfo *) iter->data;
+
+        g_hash_table_insert (table, info->uri, info);
+    }
+
+    g_list_free (infos);
+
+    return table;
+}
+
+static void
+pending_event_free (PendingEvent *pending)
+{
+    g_object_unref (pending->file);
+    g_slice_free (PendingEvent, pending);
+}
 
-    new_infos = xapp_favorites_get_favorites (favorites, NULL);
+static void
+emit_pending_event (FavoriteMonitorHub *hub,
+                    PendingEvent       *pending)
+{
+    hub_emit_event (hub, pending->file, pending->event_type);
 
-    for (iter = priv->infos; iter != NULL; iter = iter->next)
+    if (pending->event_type == G_FILE_MONITOR_EVENT_CHANGED ||
+        pending->event_type == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED)
     {
-        XAppFavoriteInfo *old_info = (XAppFavoriteInfo *) iter->data;
-        GList *res = g_list_find_custom (new_infos,
-                                         (gpointer) old_info->uri,
-                                         (GCompareFunc) find_info_by_uri);
-        if (res == NULL)
+        hub_emit_event (hub, pending->file, G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT);
+    }
+}
+
+static gboolean
+flush_pending_events (gpointer data)
+{
+    FavoriteMonitorHub *hub = (FavoriteMonitorHub *) data;
+    GHashTable *pending_events;
+    GHashTableIter iter;
+    PendingEvent *pending;
+
+    hub->flush_id = 0;
+    hub->last_flush_time = g_get_monotonic_time ();
+
+    // Handlers may change favorites (and queue new events) or cancel the
+    // last monitor while we're dispatching.
+    pending_events = hub->pending;
+    hub->pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          g_free, (GDestroyNotify) pending_event_free);
+    hub_ref (hub);
+
+    DEBUG ("Flushing %u coalesced favorite events", g_hash_table_size (pending_events));
+
+    // Deletions first, so a file manager never sees two items with the same name.
+    g_hash_table_iter_init (&iter, pending_events);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &pending))
+    {
+        if (pending->event_type == G_FILE_MONITOR_EVENT_DELETED)
         {
-            removed = g_list_prepend (removed, old_info);
+            emit_pending_event (hub, pending);
         }
     }
 
-    for (iter = new_infos; iter != NULL; iter = iter->next)
+    g_hash_table_iter_init (&iter, pending_events);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &pending))
     {
-        XAppFavoriteInfo *new_info = (XAppFavoriteInfo *) iter->data;
-        GList *res = g_list_find_custom (priv->infos,
-                                         (gpointer) new_info->uri,
-                                         (GCompareFunc) find_info_by_uri);
-        if (res == NULL)
+        if (pending->event_type != G_FILE_MONITOR_EVENT_DELETED)
         {
-            added = g_list_prepend (added, new_info);
+            emit_pending_event (hub, pending);
         }
     }
 
-    for (iter = removed; iter != NULL; iter = iter->next)
+    g_hash_table_destroy (pending_events);
+    hub_unref (hub);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_flush (FavoriteMonitorHub *hub)
+{
+    gint64 elapsed_ms;
+
+    if (hub->flush_id > 0)
     {
-        XAppFavoriteInfo *removed_info = (XAppFavoriteInfo *) iter->data;
+        return;
+    }
 
-        GFile *file = _favorite_vfs_file_new_for_info (removed_info);
+    elapsed_ms = (g_get_monotonic_time () - hub->last_flush_time) / 1000;
 
-        g_file_monitor_emit_event (G_FILE_MONITOR (monitor),
-                                   file,
-                                   NULL,
-                                   G_FILE_MONITOR_EVENT_DELETED);
-        g_file_monitor_emit_event (G_FILE_MONITOR (monitor),
-                                   file,
-                                   NULL,
-                                   G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT);
-        g_object_unref (file);
+    // The first change after a quiet period goes out right away, anything
+    // following it is batched until the rate limit allows another flush.
+    if (elapsed_ms >= EVENT_RATE_LIMIT_MS)
+    {
+        hub->flush_id = g_idle_add (flush_pending_events, hub);
+    }
+    else
+    {
+        hub->flush_id = g_timeout_add (EVENT_RATE_LIMIT_MS - elapsed_ms, flush_pending_events, hub);
+    }
+}
+
+static void
+queue_event (FavoriteMonitorHub *hub,
+             XAppFavoriteInfo   *info,
+             GFileMonitorEvent   event_type)
+{
+    PendingEvent *pending;
+    gchar *fav_uri;
+
+    fav_uri = path_to_fav_uri (info->display_name);
+    pending = g_hash_table_lookup (hub->pending, fav_uri);
+
+    if (pending == NULL)
+    {
+        pending = g_slice_new0 (PendingEvent);
+        pending->file = _favorite_vfs_file_new_for_info (info);
+        pending->event_type = event_type;
+
+        g_hash_table_insert (hub->pending, fav_uri, pending);
+        schedule_flush (hub);
+        return;
     }
 
-    for (iter = added; iter != NULL; iter = iter->next)
+    // Merge with the event already waiting for this file so only the net
+    // change is reported.
+    switch (event_type)
     {
-        XAppFavoriteInfo *added_info = (XAppFavoriteInfo *) iter->data;
+        case G_FILE_MONITOR_EVENT_DELETED:
+            if (pending->event_type == G_FILE_MONITOR_EVENT_CREATED)
+            {
+                g_hash_table_remove (hub->pending, fav_uri);
+                break;
+            }
 
-        GFile *file = _favorite_vfs_file_new_for_info (added_info);
+            pending->event_type = G_FILE_MONITOR_EVENT_DELETED;
+            break;
+        case G_FILE_MONITOR_EVENT_CREATED:
+            if (pending->event_type == G_FILE_MONITOR_EVENT_DELETED)
+            {
+                pending->event_type = G_FILE_MONITOR_EVENT_CHANGED;
+            }
+            else
+            {
+                pending->event_type = G_FILE_MONITOR_EVENT_CREATED;
+            }
 
-        g_file_monitor_emit_event (G_FILE_MONITOR (monitor),
-                                   file,
-                                   NULL,
-                                   G_FILE_MONITOR_EVENT_CREATED);
-        g_file_monitor_emit_event (G_FILE_MONITOR (monitor),
-                                   file,
-                                   NULL,
-                                   G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT);
-        g_object_unref (file);
+            g_object_unref (pending->file);
+            pending->file = _favorite_vfs_file_new_for_info (info);
+            break;
+        default:
+            // Already reported as a new, replaced or removed file.
+            break;
     }
 
-    g_list_free (added);
-    g_list_free (removed);
+    g_free (fav_uri);
+}
+
+static void
+favorites_changed (XAppFavorites *favorites,
+                   gpointer       user_data)
+{
+    g_return_if_fail (XAPP_IS_FAVORITES (favorites));
+
+    FavoriteMonitorHub *hub = (FavoriteMonitorHub *) user_data;
+    GHashTable *new_infos;
+    GHashTableIter iter;
+    XAppFavoriteInfo *info;
+
+    new_infos = infos_table_new (xapp_favorites_get_favorites (favorites, NULL));
 
-    GList *tmp = priv->infos;
-    priv->infos = new_infos;
+    g_hash_table_iter_init (&iter, hub->infos);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &info))
+    {
+        XAppFavoriteInfo *new_info = g_hash_table_lookup (new_infos, info->uri);
+
+        if (new_info == NULL)
+        {
+            uri_trie_remove (hub->trie, info->uri);
+            queue_event (hub, info, G_FILE_MONITOR_EVENT_DELETED);
+        }
+        else
+        if (g_strcmp0 (new_info->display_name, info->display_name) != 0)
+        {
+            // Deduplication gave the favorite a new name, which is a new file for us.
+            queue_event (hub, info, G_FILE_MONITOR_EVENT_DELETED);
+            queue_event (hub, new_info, G_FILE_MONITOR_EVENT_CREATED);
+        }
+    }
+
+    g_hash_table_iter_init (&iter, new_infos);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &info))
+    {
+        if (!g_hash_table_contains (hub->infos, info->uri))
+        {
+            uri_trie_insert (hub->trie, info->uri);
+            queue_event (hub, info, G_FILE_MONITOR_EVENT_CREATED);
+        }
+    }
 
-    g_list_free_full (tmp, (GDestroyNotify) xapp_favorite_info_free);
+    g_hash_table_destroy (hub->infos);
+    hub->infos = new_infos;
 
     //FIXME: add/remove individually
-    unmonitor_files (monitor);
-    monitor_files (monitor);
+    unmonitor_files (hub);
+    monitor_files (hub);
 }
 
 static void
@@ -310,122 +680,205 @@ mounts_changed (GVolumeMonitor *mount_mon,
                 GMount         *mount,
                 gpointer        user_data)
 {
-    g_return_if_fail (FAVORITE_IS_VFS_FILE_MONITOR (user_data));
-
-    FavoriteVfsFileMonitor *monitor = FAVORITE_VFS_FILE_MONITOR (user_data);
-    FavoriteVfsFileMonitorPrivate *priv = favorite_vfs_file_monitor_get_instance_private (monitor);
+    FavoriteMonitorHub *hub = (FavoriteMonitorHub *) user_data;
 
     GFile *root;
-    GList *iter, *mount_favorites;
+    GSList *uris, *l;
 
     root = g_mount_get_root (mount);
-    mount_favorites = NULL;
 
     // Find any favorites that are descendent from root.
+    uris = uri_trie_find_descendants (hub->trie, root);
 
-    for (iter = priv->infos; iter != NULL; iter = iter->next)
+    for (l = uris; l != NULL; l = l->next)
     {
-        XAppFavoriteInfo *info = (XAppFavoriteInfo *) iter->data;
-        GFile *fav_file = g_file_new_for_uri (info->uri);
-        gchar *relpath;
-
-        relpath = g_file_get_relative_path (root, fav_file);
+        XAppFavoriteInfo *info = g_hash_table_lookup (hub->infos, l->data);
 
-        if (relpath != NULL)
+        if (info != NULL)
         {
-            mount_favorites = g_list_prepend (mount_favorites, info);
+            queue_event (hub, info, G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED);
         }
+    }
+
+    g_slist_free (uris);
+    g_object_unref (root);
+
+    unmonitor_files (hub);
+    monitor_files (hub);
+}
+
+static FavoriteMonitorHub *
+hub_new (void)
+{
+    FavoriteMonitorHub *new_hub;
+    GHashTableIter iter;
+    const gchar *uri;
 
-        g_free (relpath);
-        g_object_unref (fav_file);
+    DEBUG ("Creating favorites monitor hub");
+
+    new_hub = g_slice_new0 (FavoriteMonitorHub);
+
+    new_hub->mount_mon = g_volume_monitor_get ();
+    g_signal_connect (new_hub->mount_mon,
+                      "mount-added",
+                      G_CALLBACK (mounts_changed),
+                      new_hub);
+    g_signal_connect (new_hub->mount_mon,
+                      "mount-removed",
+                      G_CALLBACK (mounts_changed),
+                      new_hub);
+    g_signal_connect (new_hub->mount_mon,
+                      "mount-changed",
+                      G_CALLBACK (mounts_changed),
+                      new_hub);
+
+    new_hub->infos = infos_table_new (xapp_favorites_get_favorites (xapp_favorites_get_default (), NULL));
+    new_hub->trie = uri_trie_node_new ();
+    g_hash_table_iter_init (&iter, new_hub->infos);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &uri, NULL))
+    {
+        uri_trie_insert (new_hub->trie, uri);
     }
 
-    if (mount_favorites != NULL)
+    new_hub->pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              g_free, (GDestroyNotify) pending_event_free);
+    new_hub->changed_handler_id = g_signal_connect (xapp_favorites_get_default (),
+                                                    "changed",
+                                                    G_CALLBACK (favorites_changed),
+                                                    new_hub);
+
+    monitor_files (new_hub);
+
+    return new_hub;
+}
+
+static void
+hub_free (FavoriteMonitorHub *old_hub)
+{
+    DEBUG ("Last favorites monitor gone, destroying hub");
+
+    unmonitor_files (old_hub);
+
+    if (old_hub->changed_handler_id > 0)
     {
-        for (iter = mount_favorites; iter != NULL; iter = iter->next) {
-            XAppFavoriteInfo *info = (XAppFavoriteInfo *) iter->data;
-            GFile *fav_file;
-            gchar *uri;
-            
-            uri = path_to_fav_uri (info->display_name);
-            fav_file = g_file_new_for_uri (uri);
+        g_signal_handler_disconnect (xapp_favorites_get_default (), old_hub->changed_handler_id);
+    }
 
-            g_file_monitor_emit_event (G_FILE_MONITOR (monitor),
-                                       fav_file,
-                                       NULL,
-                                       G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED);
-            g_file_monitor_emit_event (G_FILE_MONITOR (monitor),
-                                       fav_file,
-                                       NULL,
-                                       G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT);
+    g_signal_handlers_disconnect_by_func (old_hub->mount_mon, mounts_changed, old_hub);
+    g_clear_object (&old_hub->mount_mon);
+
+    if (old_hub->flush_id > 0)
+    {
+        g_source_remove (old_hub->flush_id);
+    }
+
+    g_hash_table_destroy (old_hub->pending);
+    g_hash_table_destroy (old_hub->infos);
+    uri_trie_node_free (old_hub->trie);
+
+    g_slice_free (FavoriteMonitorHub, old_hub);
+}
+
+static FavoriteMonitorHub *
+hub_ref (FavoriteMonitorHub *hub)
+{
+    G_LOCK (monitor_hub);
+    hub->ref_count++;
+    G_UNLOCK (monitor_hub);
+
+    return hub;
+}
+
+static void
+hub_unref (FavoriteMonitorHub *hub)
+{
+    gboolean last_ref = FALSE;
+
+    G_LOCK (monitor_hub);
 
-            g_free (uri);
-            g_object_unref (fav_file);
+    if (--hub->ref_count == 0)
+    {
+        if (monitor_hub == hub)
+        {
+            monitor_hub = NULL;
         }
 
-        g_list_free (mount_favorites);
+        last_ref = TRUE;
     }
 
-    g_object_unref (root);
+    G_UNLOCK (monitor_hub);
 
-    unmonitor_files (monitor);
-    monitor_files (monitor);
+    if (last_ref)
+    {
+        hub_free (hub);
+    }
 }
 
-static gboolean
-favorite_vfs_file_monitor_cancel (GFileMonitor* gfilemon)
+static void
+attach_monitor (FavoriteVfsFileMonitor *monitor)
 {
-    FavoriteVfsFileMonitor *monitor = FAVORITE_VFS_FILE_MONITOR (gfilemon);
     FavoriteVfsFileMonitorPrivate *priv = favorite_vfs_file_monitor_get_instance_private (monitor);
 
-    if (priv->changed_handler_id > 0)
+    G_LOCK (monitor_hub);
+
+    if (monitor_hub == NULL)
     {
-        g_signal_handler_disconnect (xapp_favorites_get_default (), priv->changed_handler_id);
+        monitor_hub = hub_new ();
     }
 
-  return TRUE;
+    monitor_hub->ref_count++;
+    monitor_hub->monitors = g_list_prepend (monitor_hub->monitors, monitor);
+    priv->hub = monitor_hub;
+
+    G_UNLOCK (monitor_hub);
 }
 
 static void
-favorite_vfs_file_monitor_init (FavoriteVfsFileMonitor *monitor)
+detach_monitor (FavoriteVfsFileMonitor *monitor)
 {
     FavoriteVfsFileMonitorPrivate *priv = favorite_vfs_file_monitor_get_instance_private (monitor);
+    FavoriteMonitorHub *hub;
 
-    priv->mount_mon = g_volume_monitor_get ();
-    g_signal_connect (priv->mount_mon,
-                      "mount-added",
-                      G_CALLBACK (mounts_changed),
-                      monitor);
-    g_signal_connect (priv->mount_mon,
-                      "mount-removed",
-                      G_CALLBACK (mounts_changed),
-                      monitor);
+    G_LOCK (monitor_hub);
+
+    hub = priv->hub;
+    priv->hub = NULL;
 
-    priv->infos = xapp_favorites_get_favorites (xapp_favorites_get_default (), NULL);
-    priv->changed_handler_id = g_signal_connect (xapp_favorites_get_default (),
-                                                 "changed",
-                                                 G_CALLBACK (favorites_changed),
-                                                 monitor);
+    if (hub != NULL)
+    {
+        hub->monitors = g_list_remove (hub->monitors, monitor);
+    }
 
-    monitor_files (monitor);
+    G_UNLOCK (monitor_hub);
+
+    if (hub != NULL)
+    {
+        hub_unref (hub);
+    }
+}
+
+static gboolean
+favorite_vfs_file_monitor_cancel (GFileMonitor* gfilemon)
+{
+    FavoriteVfsFileMonitor *monitor = FAVORITE_VFS_FILE_MONITOR (gfilemon);
+
+    detach_monitor (monitor);
+
+  return TRUE;
+}
+
+static void
+favorite_vfs_file_monitor_init (FavoriteVfsFileMonitor *monitor)
+{
+    attach_monitor (monitor);
 }
 
 static void
 favorite_vfs_file_monitor_dispose (GObject *object)
 {
     FavoriteVfsFileMonitor *monitor = FAVORITE_VFS_FILE_MONITOR(object);
-    FavoriteVfsFileMonitorPrivate *priv = favorite_vfs_file_monitor_get_instance_private(monitor);
 
-    unmonitor_files (monitor);
-
-    g_signal_handlers_disconnect_by_func (priv->mount_mon, mounts_changed, monitor);
-    g_clear_object (&priv->mount_mon);
-
-    if (priv->infos != NULL)
-    {
-        g_list_free_full (priv->infos, (GDestroyNotify) xapp_favorite_info_free);
-        priv->infos = NULL;
-    }
+    detach_monitor (monitor);
 
     G_OBJECT_CLASS (favorite_vfs_file_monitor_parent_class)->dispose (object);
 }
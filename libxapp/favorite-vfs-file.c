@@ -1,5 +1,18 @@
 #include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_FICLONE
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
 
 #include "favorite-vfs-file.h"
 #include "favorite-vfs-file-enumerator.h"
@@ -363,6 +376,196 @@ file_enumerate_children(GFile               *file,
     return enumerator;
 }
 
+#define THUMB_MTIME_KEY "Thumb::MTime"
+
+static guint32
+read_png_uint32 (const guchar *data)
+{
+    return ((guint32) data[0] << 24) | ((guint32) data[1] << 16) | ((guint32) data[2] << 8) | data[3];
+}
+
+/* Reads the modification time of the file a thumbnail was made from, which the
+ * thumbnail spec keeps in a Thumb::MTime text chunk. Like GIO, this walks the
+ * chunks of the mapped file, rather than decoding the image. */
+static gboolean
+get_thumbnail_source_mtime (const gchar *path,
+                            guint64     *mtime)
+{
+    static const guchar png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    GMappedFile *mapped;
+    const guchar *data;
+    gsize len, offset;
+    gboolean found;
+
+    mapped = g_mapped_file_new (path, FALSE, NULL);
+
+    if (mapped == NULL)
+    {
+        return FALSE;
+    }
+
+    data = (const guchar *) g_mapped_file_get_contents (mapped);
+    len = g_mapped_file_get_length (mapped);
+    found = FALSE;
+
+    if (len < sizeof (png_signature) || memcmp (data, png_signature, sizeof (png_signature)) != 0)
+    {
+        g_mapped_file_unref (mapped);
+        return FALSE;
+    }
+
+    offset = sizeof (png_signature);
+
+    // Each chunk is its length, type, data and a checksum.
+    while (!found && len - offset >= 12)
+    {
+        guint32 chunk_len = read_png_uint32 (data + offset);
+        const guchar *type = data + offset + 4;
+        const gchar *chunk = (const gchar *) data + offset + 8;
+
+        if (chunk_len > len - offset - 12 || memcmp (type, "IEND", 4) == 0)
+        {
+            break;
+        }
+
+        // tEXt is a keyword, a nul, then the text (not nul-terminated).
+        if (memcmp (type, "tEXt", 4) == 0 &&
+            chunk_len > sizeof (THUMB_MTIME_KEY) &&
+            memcmp (chunk, THUMB_MTIME_KEY, sizeof (THUMB_MTIME_KEY)) == 0)
+        {
+            gchar *value, *end;
+
+            value = g_strndup (chunk + sizeof (THUMB_MTIME_KEY), chunk_len - sizeof (THUMB_MTIME_KEY));
+            *mtime = g_ascii_strtoull (value, &end, 10);
+            found = end != value && *end == '\0';
+
+            g_free (value);
+        }
+
+        offset += 12 + (gsize) chunk_len;
+    }
+
+    g_mapped_file_unref (mapped);
+
+    return found;
+}
+
+/* The sizes file managers use most are checked first */
+static const gchar *thumbnail_sizes[] = { "large", "normal", "x-large", "xx-large", NULL };
+
+/* GIO only fills in the thumbnail attributes for some backends (and, for
+ * native files, only when it's asked directly). Look the real uri up in the
+ * freedesktop thumbnail cache ourselves, so file managers use the existing
+ * thumbnail instead of waking the thumbnailers for favorites:// files.
+ *
+ * As in GIO, a thumbnail is only valid if the mtime it was made from matches
+ * the file's. If the file's mtime isn't known, the first thumbnail found is
+ * used, and it's left to the file manager to decide whether it's valid. A
+ * failed thumbnail is only reported if it was made from the current mtime. */
+static void
+add_cached_thumbnail_attributes (GFileInfo   *info,
+                                 const gchar *real_uri,
+                                 const char  *attributes)
+{
+    GFileAttributeMatcher *matcher;
+    gboolean want_path, want_failed, have_mtime;
+    gchar *checksum, *basename, *path, *stale_path;
+    guint64 mtime;
+    gint i;
+
+    matcher = g_file_attribute_matcher_new (attributes);
+
+    want_path = g_file_attribute_matcher_matches (matcher, G_FILE_ATTRIBUTE_THUMBNAIL_PATH) &&
+                !g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_THUMBNAIL_PATH);
+    want_failed = g_file_attribute_matcher_matches (matcher, G_FILE_ATTRIBUTE_THUMBNAILING_FAILED) &&
+                  !g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_THUMBNAILING_FAILED);
+
+    g_file_attribute_matcher_unref (matcher);
+
+    if (!want_path && !want_failed)
+    {
+        return;
+    }
+
+    checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, real_uri, -1);
+    basename = g_strconcat (checksum, ".png", NULL);
+    g_free (checksum);
+
+    have_mtime = g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+
+    // The first thumbnail found, in case none of them are valid.
+    stale_path = NULL;
+
+    for (i = 0; want_path && thumbnail_sizes[i] != NULL; i++)
+    {
+        guint64 thumb_mtime;
+
+        path = g_build_filename (g_get_user_cache_dir (), "thumbnails", thumbnail_sizes[i], basename, NULL);
+
+        if (!g_file_test (path, G_FILE_TEST_IS_REGULAR))
+        {
+            g_free (path);
+            continue;
+        }
+
+        if (have_mtime && get_thumbnail_source_mtime (path, &thumb_mtime) && thumb_mtime == mtime)
+        {
+            DEBUG ("Found cached thumbnail for %s: %s", real_uri, path);
+
+            g_file_info_set_attribute_byte_string (info, G_FILE_ATTRIBUTE_THUMBNAIL_PATH, path);
+            g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_THUMBNAIL_IS_VALID, TRUE);
+            want_failed = FALSE;
+            want_path = FALSE;
+
+            g_free (path);
+            break;
+        }
+
+        if (stale_path == NULL)
+        {
+            stale_path = path;
+        }
+        else
+        {
+            g_free (path);
+        }
+    }
+
+    if (want_path && stale_path != NULL)
+    {
+        DEBUG ("Found cached thumbnail for %s, but it may be out of date: %s", real_uri, stale_path);
+
+        g_file_info_set_attribute_byte_string (info, G_FILE_ATTRIBUTE_THUMBNAIL_PATH, stale_path);
+
+        if (have_mtime)
+        {
+            g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_THUMBNAIL_IS_VALID, FALSE);
+        }
+    }
+
+    g_free (stale_path);
+
+    if (want_failed && have_mtime)
+    {
+        guint64 thumb_mtime;
+
+        path = g_build_filename (g_get_user_cache_dir (),
+                                 "thumbnails", "fail", "gnome-thumbnail-factory", basename,
+                                 NULL);
+
+        if (g_file_test (path, G_FILE_TEST_IS_REGULAR) &&
+            get_thumbnail_source_mtime (path, &thumb_mtime) && thumb_mtime == mtime)
+        {
+            g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_THUMBNAILING_FAILED, TRUE);
+        }
+
+        g_free (path);
+    }
+
+    g_free (basename);
+}
+
 static GFileInfo *
 file_query_info (GFile               *file,
                  const char          *attributes,
@@ -413,6 +616,8 @@ file_query_info (GFile               *file,
             g_file_info_set_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_TARGET_URI, priv->info->uri);
 
             g_file_info_set_attribute_string (info, FAVORITE_AVAILABLE_METADATA_KEY, META_TRUE);
+
+            add_cached_thumbnail_attributes (info, priv->info->uri, attributes);
         }
         else
         {
@@ -1129,6 +1334,219 @@ file_trash (GFile         *file,
     return file_delete (file, cancellable, error);
 }
 
+#define COPY_CHUNK_SIZE (8 * 1024 * 1024)
+
+/* Copies a local regular file and lets the kernel do the work - a reflink if
+ * the filesystem supports it, otherwise copy_file_range(). The copy is made in
+ * a temporary file next to the destination, which only replaces (or becomes)
+ * the destination once it's complete, so an existing file is never touched
+ * if the copy fails. If this can't be done, G_IO_ERROR_NOT_SUPPORTED is
+ * returned with nothing left behind, and the caller should fall back to GIO,
+ * which also takes care of reporting any errors about the source or
+ * destination. */
+static gboolean
+copy_local_file_fast (GFile                  *source,
+                      GFile                  *destination,
+                      GFileCopyFlags          flags,
+                      GCancellable           *cancellable,
+                      GFileProgressCallback   progress_callback,
+                      gpointer                progress_callback_data,
+                      GError                **error)
+{
+#if defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_FICLONE)
+    g_autofree gchar *src_path = NULL;
+    g_autofree gchar *dest_path = NULL;
+    g_autofree gchar *dest_dir = NULL;
+    g_autofree gchar *dest_base = NULL;
+    g_autofree gchar *tmp_path = NULL;
+    GStatBuf src_stat, dest_stat;
+    goffset total, copied;
+    gboolean done;
+    gboolean replace;
+    gint src_fd, dest_fd;
+    mode_t mode;
+
+    src_path = g_file_get_path (source);
+    dest_path = g_file_get_path (destination);
+
+    if (src_path == NULL || dest_path == NULL || (flags & G_FILE_COPY_BACKUP))
+    {
+        goto not_supported;
+    }
+
+    if (((flags & G_FILE_COPY_NOFOLLOW_SYMLINKS) ? g_lstat (src_path, &src_stat)
+                                                 : g_stat (src_path, &src_stat)) != 0 ||
+        !S_ISREG (src_stat.st_mode))
+    {
+        goto not_supported;
+    }
+
+    replace = FALSE;
+
+    if (g_lstat (dest_path, &dest_stat) == 0)
+    {
+        if (!(flags & G_FILE_COPY_OVERWRITE) || !S_ISREG (dest_stat.st_mode) ||
+            (dest_stat.st_dev == src_stat.st_dev && dest_stat.st_ino == src_stat.st_ino))
+        {
+            goto not_supported;
+        }
+
+        replace = TRUE;
+    }
+
+    mode = (flags & G_FILE_COPY_TARGET_DEFAULT_PERMS) ? 0666 : (src_stat.st_mode & 0777);
+
+    src_fd = g_open (src_path, O_RDONLY | O_CLOEXEC, 0);
+
+    if (src_fd < 0)
+    {
+        goto not_supported;
+    }
+
+    dest_dir = g_path_get_dirname (dest_path);
+    dest_base = g_path_get_basename (dest_path);
+    tmp_path = g_strdup_printf ("%s/.%s.XXXXXX", dest_dir, dest_base);
+
+    dest_fd = g_mkstemp_full (tmp_path, O_WRONLY | O_CLOEXEC, mode);
+
+    if (dest_fd < 0)
+    {
+        close (src_fd);
+        goto not_supported;
+    }
+
+    total = src_stat.st_size;
+    copied = 0;
+    done = FALSE;
+
+#ifdef HAVE_FICLONE
+    if (ioctl (dest_fd, FICLONE, src_fd) == 0)
+    {
+        copied = total;
+        done = TRUE;
+    }
+#endif
+
+#ifdef HAVE_COPY_FILE_RANGE
+    while (!done)
+    {
+        gssize n;
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        {
+            goto failed;
+        }
+
+        n = copy_file_range (src_fd, NULL, dest_fd, NULL, COPY_CHUNK_SIZE, 0);
+
+        if (n < 0)
+        {
+            int errsv = errno;
+
+            if (errsv == EINTR)
+            {
+                continue;
+            }
+
+            // Older kernels and some filesystems can't do this (or not across filesystems).
+            if (copied == 0 && (errsv == ENOSYS || errsv == EXDEV || errsv == EOPNOTSUPP || errsv == EINVAL))
+            {
+                break;
+            }
+
+            g_set_error (error, G_IO_ERROR,
+                         g_io_error_from_errno (errsv),
+                         _("Error copying file: %s"), g_strerror (errsv));
+            goto failed;
+        }
+
+        if (n == 0)
+        {
+            done = TRUE;
+            break;
+        }
+
+        copied += n;
+
+        if (progress_callback != NULL)
+        {
+            progress_callback (copied, total, progress_callback_data);
+        }
+    }
+#endif
+
+    if (!done)
+    {
+        close (src_fd);
+        close (dest_fd);
+        g_unlink (tmp_path);
+        goto not_supported;
+    }
+
+    close (src_fd);
+
+    if (close (dest_fd) != 0)
+    {
+        int errsv = errno;
+
+        g_set_error (error, G_IO_ERROR,
+                     g_io_error_from_errno (errsv),
+                     _("Error copying file: %s"), g_strerror (errsv));
+        g_unlink (tmp_path);
+        return FALSE;
+    }
+
+    if (replace)
+    {
+        if (g_rename (tmp_path, dest_path) != 0)
+        {
+            g_unlink (tmp_path);
+            goto not_supported;
+        }
+    }
+    else
+    {
+        /* link() won't replace anything that appeared at the destination in
+         * the meantime, where rename() would. */
+        if (link (tmp_path, dest_path) != 0)
+        {
+            g_unlink (tmp_path);
+            goto not_supported;
+        }
+
+        g_unlink (tmp_path);
+    }
+
+    if (progress_callback != NULL)
+    {
+        progress_callback (copied, total, progress_callback_data);
+    }
+
+    // Like GIO's own fallback, failing to copy metadata isn't a hard error.
+    g_file_copy_attributes (source, destination, flags, cancellable, NULL);
+
+    DEBUG ("Copied %s using the fast path", src_path);
+
+    return TRUE;
+
+#ifdef HAVE_COPY_FILE_RANGE
+failed:
+    close (src_fd);
+    close (dest_fd);
+    g_unlink (tmp_path);
+
+    return FALSE;
+#endif
+
+not_supported:
+#endif
+    g_set_error_literal (error, G_IO_ERROR,
+                         G_IO_ERROR_NOT_SUPPORTED,
+                         "Fast copy not supported");
+
+    return FALSE;
+}
+
 gboolean
 file_copy (GFile                  *source,
            GFile                  *destination,
@@ -1138,20 +1556,149 @@ file_copy (GFile                  *source,
            gpointer                progress_callback_data,
            GError                **error)
 {
-    FavoriteVfsFilePrivate *priv = favorite_vfs_file_get_instance_private (FAVORITE_VFS_FILE (source));
+    FavoriteVfsFilePrivate *priv;
+
+    // GIO tries the destination's copy too, when the source is some other kind of file.
+    if (!FAVORITE_IS_VFS_FILE (source))
+    {
+        g_set_error_literal (error, G_IO_ERROR,
+                             G_IO_ERROR_NOT_SUPPORTED,
+                            _("Operation not supported"));
+
+        return FALSE;
+    }
+
+    priv = favorite_vfs_file_get_instance_private (FAVORITE_VFS_FILE (source));
 
     if (priv->info != NULL && priv->info->uri != NULL)
     {
         gboolean res;
+        GError *fast_error = NULL;
         GFile *real_file = g_file_new_for_uri (priv->info->uri);
 
-        res = g_file_copy (real_file,
+        res = copy_local_file_fast (real_file,
+                                    destination,
+                                    flags,
+                                    cancellable,
+                                    progress_callback,
+                                    progress_callback_data,
+                                    &fast_error);
+
+        if (!res)
+        {
+            if (g_error_matches (fast_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+            {
+                g_clear_error (&fast_error);
+
+                res = g_file_copy (real_file,
+                                   destination,
+                                   flags,
+                                   cancellable,
+                                   progress_callback,
+                                   progress_callback_data,
+                                   error);
+            }
+            else
+            {
+                g_propagate_error (error, fast_error);
+            }
+        }
+
+        g_object_unref (real_file);
+        return res;
+    }
+
+    g_set_error_literal (error, G_IO_ERROR,
+                         G_IO_ERROR_NOT_SUPPORTED,
+                        _("Operation not supported"));
+
+    return FALSE;
+}
+
+static gboolean
+file_move (GFile                  *source,
+           GFile                  *destination,
+           GFileCopyFlags          flags,
+           GCancellable           *cancellable,
+           GFileProgressCallback   progress_callback,
+           gpointer                progress_callback_data,
+           GError                **error)
+{
+    FavoriteVfsFilePrivate *priv;
+
+    // GIO tries the destination's move first, so the source may be some other kind of file.
+    if (!FAVORITE_IS_VFS_FILE (source))
+    {
+        g_set_error_literal (error, G_IO_ERROR,
+                             G_IO_ERROR_NOT_SUPPORTED,
+                            _("Operation not supported"));
+
+        return FALSE;
+    }
+
+    priv = favorite_vfs_file_get_instance_private (FAVORITE_VFS_FILE (source));
+
+    if (priv->info != NULL && priv->info->uri != NULL)
+    {
+        gboolean res;
+        GError *move_error = NULL;
+        GFile *real_file = g_file_new_for_uri (priv->info->uri);
+
+        // This is a plain rename if the destination is on the same filesystem.
+        res = g_file_move (real_file,
                            destination,
-                           flags,
+                           flags | G_FILE_COPY_NO_FALLBACK_FOR_MOVE,
                            cancellable,
                            progress_callback,
                            progress_callback_data,
-                           error);
+                           &move_error);
+
+        if (!res &&
+            !(flags & G_FILE_COPY_NO_FALLBACK_FOR_MOVE) &&
+            g_error_matches (move_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+        {
+            g_clear_error (&move_error);
+
+            res = copy_local_file_fast (real_file,
+                                        destination,
+                                        flags,
+                                        cancellable,
+                                        progress_callback,
+                                        progress_callback_data,
+                                        &move_error);
+
+            if (res)
+            {
+                res = g_file_delete (real_file, cancellable, &move_error);
+            }
+            else
+            if (g_error_matches (move_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+            {
+                g_clear_error (&move_error);
+
+                // Directories, remote files etc. - let GIO do its copy and delete.
+                res = g_file_move (real_file,
+                                   destination,
+                                   flags,
+                                   cancellable,
+                                   progress_callback,
+                                   progress_callback_data,
+                                   &move_error);
+            }
+        }
+
+        if (res)
+        {
+            gchar *dest_uri = g_file_get_uri (destination);
+
+            // The favorite follows the file, the same as a rename.
+            xapp_favorites_rename (xapp_favorites_get_default (), priv->info->uri, dest_uri);
+            g_free (dest_uri);
+        }
+        else
+        {
+            g_propagate_error (error, move_error);
+        }
 
         g_object_unref (real_file);
         return res;
@@ -1229,6 +1776,315 @@ file_monitor_file (GFile              *file,
     return NULL;
 }
 
+#define MEASURE_MAX_THREADS 4
+#define MEASURE_REPORT_INTERVAL_US (200 * G_TIME_SPAN_MILLISECOND)
+
+/* Measuring favorites:/// measures every favorite's target, several at a time
+ * on a small thread pool. The workers only record their results, progress is
+ * reported from the calling thread. */
+typedef struct
+{
+    GFile *file;
+    guint64 disk_usage;
+    guint64 num_dirs;
+    guint64 num_files;
+} MeasureTarget;
+
+typedef struct
+{
+    GMutex lock;
+    GCond cond;
+
+    GFileMeasureFlags flags;
+    GCancellable *cancellable;  // Ours, cancelled with the caller's or on the first error
+
+    GPtrArray *targets;
+    guint pending;
+    gboolean updated;
+
+    GError *error;
+} MeasureJob;
+
+static void
+measure_target_progress (gboolean reporting,
+                         guint64  current_size,
+                         guint64  num_dirs,
+                         guint64  num_files,
+                         gpointer user_data)
+{
+    MeasureTarget *target = (MeasureTarget *) ((gpointer *) user_data)[0];
+    MeasureJob *job = (MeasureJob *) ((gpointer *) user_data)[1];
+
+    g_mutex_lock (&job->lock);
+
+    target->disk_usage = current_size;
+    target->num_dirs = num_dirs;
+    target->num_files = num_files;
+    job->updated = TRUE;
+
+    g_mutex_unlock (&job->lock);
+}
+
+static void
+measure_target_thread (gpointer data,
+                       gpointer user_data)
+{
+    MeasureTarget *target = (MeasureTarget *) data;
+    MeasureJob *job = (MeasureJob *) user_data;
+    gpointer progress_data[2] = { target, job };
+    guint64 disk_usage, num_dirs, num_files;
+    GError *error = NULL;
+    gboolean stop_others = FALSE;
+
+    if (g_file_measure_disk_usage (target->file,
+                                   job->flags,
+                                   job->cancellable,
+                                   measure_target_progress,
+                                   progress_data,
+                                   &disk_usage,
+                                   &num_dirs,
+                                   &num_files,
+                                   &error))
+    {
+        measure_target_progress (FALSE, disk_usage, num_dirs, num_files, progress_data);
+    }
+
+    g_mutex_lock (&job->lock);
+
+    if (error != NULL)
+    {
+        // Missing or unmounted favorites simply don't count, unless asked otherwise.
+        if (job->error == NULL &&
+            ((job->flags & G_FILE_MEASURE_REPORT_ANY_ERROR) ||
+             g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)))
+        {
+            job->error = error;
+            error = NULL;
+            stop_others = TRUE;
+        }
+
+        g_clear_error (&error);
+    }
+
+    job->pending--;
+    g_cond_signal (&job->cond);
+
+    g_mutex_unlock (&job->lock);
+
+    // The result is an error now, there's no point measuring the rest.
+    if (stop_others)
+    {
+        g_cancellable_cancel (job->cancellable);
+    }
+}
+
+static void
+on_measure_cancelled (GCancellable *cancellable,
+                      gpointer      user_data)
+{
+    g_cancellable_cancel (G_CANCELLABLE (user_data));
+}
+
+static void
+measure_job_sum (MeasureJob *job,
+                 guint64    *disk_usage,
+                 guint64    *num_dirs,
+                 guint64    *num_files)
+{
+    guint i;
+
+    *disk_usage = *num_dirs = *num_files = 0;
+
+    for (i = 0; i < job->targets->len; i++)
+    {
+        MeasureTarget *target = g_ptr_array_index (job->targets, i);
+
+        *disk_usage += target->disk_usage;
+        *num_dirs += target->num_dirs;
+        *num_files += target->num_files;
+    }
+}
+
+static void
+measure_target_free (MeasureTarget *target)
+{
+    g_object_unref (target->file);
+    g_slice_free (MeasureTarget, target);
+}
+
+static gboolean
+has_favorite_ancestor (GHashTable *all_files,
+                       GFile      *file)
+{
+    GFile *parent;
+    gboolean found = FALSE;
+
+    parent = g_file_get_parent (file);
+
+    while (parent != NULL && !found)
+    {
+        GFile *next;
+
+        found = g_hash_table_contains (all_files, parent);
+
+        next = g_file_get_parent (parent);
+        g_object_unref (parent);
+        parent = next;
+    }
+
+    g_clear_object (&parent);
+
+    return found;
+}
+
+// Returns the favorite targets, minus duplicates and any inside another one.
+static GPtrArray *
+get_measure_targets (void)
+{
+    GHashTable *all_files;
+    GPtrArray *targets;
+    GList *infos, *iter;
+    GHashTableIter hiter;
+    GFile *file;
+
+    infos = xapp_favorites_get_favorites (xapp_favorites_get_default (), NULL);
+
+    // A set, so duplicate targets collapse into one.
+    all_files = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+                                       g_object_unref, NULL);
+
+    for (iter = infos; iter != NULL; iter = iter->next)
+    {
+        XAppFavoriteInfo *info = (XAppFavoriteInfo *) iter->data;
+
+        g_hash_table_add (all_files, g_file_new_for_uri (info->uri));
+    }
+
+    g_list_free_full (infos, (GDestroyNotify) xapp_favorite_info_free);
+
+    targets = g_ptr_array_new_with_free_func ((GDestroyNotify) measure_target_free);
+
+    g_hash_table_iter_init (&hiter, all_files);
+    while (g_hash_table_iter_next (&hiter, (gpointer *) &file, NULL))
+    {
+        MeasureTarget *target;
+
+        if (has_favorite_ancestor (all_files, file))
+        {
+            continue;
+        }
+
+        target = g_slice_new0 (MeasureTarget);
+        target->file = g_object_ref (file);
+        g_ptr_array_add (targets, target);
+    }
+
+    g_hash_table_destroy (all_files);
+
+    return targets;
+}
+
+static gboolean
+measure_root_disk_usage (GFileMeasureFlags              flags,
+                         GCancellable                  *cancellable,
+                         GFileMeasureProgressCallback   progress_callback,
+                         gpointer                       progress_data,
+                         guint64                       *disk_usage,
+                         guint64                       *num_dirs,
+                         guint64                       *num_files,
+                         GError                       **error)
+{
+    MeasureJob job = { 0 };
+    GThreadPool *pool;
+    guint64 total_size, total_dirs, total_files;
+    gulong cancelled_id = 0;
+    guint i;
+
+    g_mutex_init (&job.lock);
+    g_cond_init (&job.cond);
+    job.flags = flags;
+    job.cancellable = g_cancellable_new ();
+    job.targets = get_measure_targets ();
+    job.pending = job.targets->len;
+
+    DEBUG ("Measuring %u favorite targets", job.targets->len);
+
+    if (cancellable != NULL)
+    {
+        cancelled_id = g_cancellable_connect (cancellable,
+                                              G_CALLBACK (on_measure_cancelled),
+                                              job.cancellable,
+                                              NULL);
+    }
+
+    pool = g_thread_pool_new (measure_target_thread,
+                              &job,
+                              MIN (MEASURE_MAX_THREADS, MAX (1, (gint) g_get_num_processors ())),
+                              FALSE,
+                              NULL);
+
+    for (i = 0; i < job.targets->len; i++)
+    {
+        g_thread_pool_push (pool, g_ptr_array_index (job.targets, i), NULL);
+    }
+
+    g_mutex_lock (&job.lock);
+
+    while (job.pending > 0)
+    {
+        g_cond_wait_until (&job.cond, &job.lock, g_get_monotonic_time () + MEASURE_REPORT_INTERVAL_US);
+
+        if (progress_callback != NULL && job.updated && job.pending > 0)
+        {
+            job.updated = FALSE;
+            measure_job_sum (&job, &total_size, &total_dirs, &total_files);
+
+            g_mutex_unlock (&job.lock);
+            progress_callback (TRUE, total_size, total_dirs, total_files, progress_data);
+            g_mutex_lock (&job.lock);
+        }
+    }
+
+    g_mutex_unlock (&job.lock);
+
+    g_thread_pool_free (pool, FALSE, TRUE);
+
+    if (cancellable != NULL)
+    {
+        g_cancellable_disconnect (cancellable, cancelled_id);
+    }
+
+    g_object_unref (job.cancellable);
+
+    measure_job_sum (&job, &total_size, &total_dirs, &total_files);
+
+    g_ptr_array_unref (job.targets);
+    g_cond_clear (&job.cond);
+    g_mutex_clear (&job.lock);
+
+    if (job.error != NULL)
+    {
+        g_propagate_error (error, job.error);
+        return FALSE;
+    }
+
+    if (progress_callback != NULL)
+    {
+        progress_callback (FALSE, total_size, total_dirs, total_files, progress_data);
+    }
+
+    if (disk_usage != NULL)
+        *disk_usage = total_size;
+
+    if (num_dirs != NULL)
+        *num_dirs = total_dirs;
+
+    if (num_files != NULL)
+        *num_files = total_files;
+
+    return TRUE;
+}
+
 gboolean
 file_measure_disk_usage (GFile                         *file,
                          GFileMeasureFlags              flags,
@@ -1260,6 +2116,18 @@ file_measure_disk_usage (GFile                         *file,
         g_object_unref (real_file);
         return res;
     }
+    else
+    if (is_root_file (FAVORITE_VFS_FILE (file)))
+    {
+        return measure_root_disk_usage (flags,
+                                        cancellable,
+                                        progress_callback,
+                                        progress_data,
+                                        disk_usage,
+                                        num_dirs,
+                                        num_files,
+                                        error);
+    }
 
     g_set_error_literal (error, G_IO_ERROR,
                          G_IO_ERROR_NOT_SUPPORTED,
@@ -1306,6 +2174,7 @@ static void favorite_vfs_file_gfile_iface_init (GFileIface *iface)
     // iface->make_directory = file_make_directory; ### Don't support
     // iface->make_symbolic_link = file_make_symbolic_link; ### Don't support
     iface->copy = file_copy;
+    iface->move = file_move;
     iface->monitor_dir = file_monitor_dir;
     iface->monitor_file = file_monitor_file;
     iface->measure_disk_usage = file_measure_disk_usage;
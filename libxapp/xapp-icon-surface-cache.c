@@ -0,0 +1,609 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "xapp-icon-surface-cache.h"
+
+#define DEBUG_FLAG XAPP_DEBUG_STATUS_ICON
+#include "xapp-debug.h"
+
+#define DEFAULT_MAX_ENTRIES 128
+
+/**
+ * SECTION:xapp-icon-surface-cache
+ * @Short_description: Loads and caches icon surfaces for status applets.
+ * @Title: XAppIconSurfaceCache
+ *
+ * An #XAppIconSurfaceCache turns an icon string (as found in an #XAppStatusIcon's
+ * IconName property - either a themed icon name or an absolute path) into a cairo
+ * surface at a given size and scale.
+ *
+ * Loading happens on a worker thread, and the result is kept in a least-recently-used
+ * cache, so an icon that comes back (a status icon switching between a few states, say)
+ * is available right away. Requests for something already loading share that load.
+ *
+ * Cached themed icons are dropped when the icon theme changes. Files are checked
+ * (off the main thread) each time they're requested, and reloaded if they've been
+ * modified since.
+ *
+ * Symbolic icons are loaded in their default colors - they aren't recolored to
+ * match a style.
+ *
+ * Most applets should share xapp_icon_surface_cache_get_default().
+ *
+ * Since: 3.4
+ */
+
+typedef struct
+{
+    gchar *key;
+    cairo_surface_t *surface;
+    gboolean is_file;
+
+    guint64 mtime;
+    guint32 mtime_usec;
+    goffset size;
+} CacheEntry;
+
+typedef struct
+{
+    gchar *key;
+    gchar *pending_key;
+    guint generation;
+
+    gchar *path;           // For file icons
+    GtkIconInfo *info;     // For themed icons
+    gint size;
+    gint scale;
+
+    // For file icons that are already cached, to be revalidated.
+    cairo_surface_t *cached_surface;
+    guint64 cached_mtime;
+    guint32 cached_mtime_usec;
+    goffset cached_size;
+
+    // Results
+    cairo_surface_t *surface;
+    guint64 mtime;
+    guint32 mtime_usec;
+    goffset file_size;
+} LoadData;
+
+struct _XAppIconSurfaceCache
+{
+    GObject parent_instance;
+
+    guint max_entries;
+
+    GQueue entries;       // CacheEntry, most recently used first
+    GHashTable *index;    // key -> GList link in entries
+    GHashTable *pending;  // generation + key -> GList of waiting GTasks
+
+    // Loads started before the last invalidation aren't cached.
+    guint generation;
+
+    GtkIconTheme *theme;
+    gulong theme_changed_id;
+};
+
+G_DEFINE_TYPE (XAppIconSurfaceCache, xapp_icon_surface_cache, G_TYPE_OBJECT)
+
+static XAppIconSurfaceCache *default_cache = NULL;
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+    g_free (entry->key);
+    cairo_surface_destroy (entry->surface);
+
+    g_slice_free (CacheEntry, entry);
+}
+
+static void
+load_data_free (LoadData *data)
+{
+    g_free (data->key);
+    g_free (data->pending_key);
+    g_free (data->path);
+    g_clear_object (&data->info);
+    g_clear_pointer (&data->cached_surface, cairo_surface_destroy);
+    g_clear_pointer (&data->surface, cairo_surface_destroy);
+
+    g_slice_free (LoadData, data);
+}
+
+static void
+remove_entry (XAppIconSurfaceCache *cache,
+              GList                *link)
+{
+    CacheEntry *entry = link->data;
+
+    g_hash_table_remove (cache->index, entry->key);
+    g_queue_delete_link (&cache->entries, link);
+
+    cache_entry_free (entry);
+}
+
+static void
+clear_entries (XAppIconSurfaceCache *cache,
+               gboolean              themed_only)
+{
+    GList *link, *next;
+
+    for (link = cache->entries.head; link != NULL; link = next)
+    {
+        CacheEntry *entry = link->data;
+        next = link->next;
+
+        if (themed_only && entry->is_file)
+        {
+            continue;
+        }
+
+        remove_entry (cache, link);
+    }
+
+    cache->generation++;
+}
+
+static void
+add_entry (XAppIconSurfaceCache *cache,
+           LoadData             *data)
+{
+    CacheEntry *entry;
+    GList *link;
+
+    link = g_hash_table_lookup (cache->index, data->key);
+
+    if (link != NULL)
+    {
+        remove_entry (cache, link);
+    }
+
+    entry = g_slice_new0 (CacheEntry);
+    entry->key = g_strdup (data->key);
+    entry->surface = cairo_surface_reference (data->surface);
+    entry->is_file = data->path != NULL;
+    entry->mtime = data->mtime;
+    entry->mtime_usec = data->mtime_usec;
+    entry->size = data->file_size;
+
+    g_queue_push_head (&cache->entries, entry);
+    g_hash_table_insert (cache->index, entry->key, cache->entries.head);
+
+    while (cache->entries.length > cache->max_entries)
+    {
+        remove_entry (cache, cache->entries.tail);
+    }
+}
+
+static void
+on_icon_theme_changed (GtkIconTheme         *theme,
+                       XAppIconSurfaceCache *cache)
+{
+    DEBUG ("Icon theme changed, dropping cached themed icons");
+
+    clear_entries (cache, TRUE);
+}
+
+static void
+load_thread (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+    LoadData *data = task_data;
+    GdkPixbuf *pixbuf;
+    GError *error = NULL;
+
+    if (data->path != NULL)
+    {
+        GFile *file;
+        GFileInfo *info;
+
+        file = g_file_new_for_path (data->path);
+        info = g_file_query_info (file,
+                                  G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                                  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+                                  G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                  G_FILE_QUERY_INFO_NONE,
+                                  NULL,
+                                  &error);
+        g_object_unref (file);
+
+        if (info == NULL)
+        {
+            g_task_return_error (task, error);
+            return;
+        }
+
+        data->mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+        data->mtime_usec = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+        data->file_size = g_file_info_get_size (info);
+        g_object_unref (info);
+
+        if (data->cached_surface != NULL &&
+            data->cached_mtime == data->mtime &&
+            data->cached_mtime_usec == data->mtime_usec &&
+            data->cached_size == data->file_size)
+        {
+            data->surface = cairo_surface_reference (data->cached_surface);
+            g_task_return_boolean (task, TRUE);
+            return;
+        }
+
+        pixbuf = gdk_pixbuf_new_from_file_at_size (data->path,
+                                                   data->size * data->scale,
+                                                   data->size * data->scale,
+                                                   &error);
+    }
+    else
+    {
+        pixbuf = gtk_icon_info_load_icon (data->info, &error);
+    }
+
+    if (pixbuf == NULL)
+    {
+        g_task_return_error (task, error);
+        return;
+    }
+
+    data->surface = gdk_cairo_surface_create_from_pixbuf (pixbuf, data->scale, NULL);
+    g_object_unref (pixbuf);
+
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+on_load_finished (GObject      *source,
+                  GAsyncResult *res,
+                  gpointer      user_data)
+{
+    XAppIconSurfaceCache *cache = XAPP_ICON_SURFACE_CACHE (source);
+    LoadData *data = g_task_get_task_data (G_TASK (res));
+    GList *waiters, *l;
+    GError *error = NULL;
+
+    g_task_propagate_boolean (G_TASK (res), &error);
+
+    waiters = g_hash_table_lookup (cache->pending, data->pending_key);
+    g_hash_table_remove (cache->pending, data->pending_key);
+
+    if (error == NULL)
+    {
+        if (data->generation == cache->generation)
+        {
+            add_entry (cache, data);
+        }
+    }
+    else
+    {
+        DEBUG ("Could not load icon '%s': %s", data->path != NULL ? data->path : data->key, error->message);
+
+        // Don't keep serving a file that can't be loaded anymore.
+        if (data->cached_surface != NULL)
+        {
+            GList *link = g_hash_table_lookup (cache->index, data->key);
+
+            if (link != NULL)
+            {
+                remove_entry (cache, link);
+            }
+        }
+    }
+
+    for (l = waiters; l != NULL; l = l->next)
+    {
+        GTask *task = G_TASK (l->data);
+
+        if (g_task_return_error_if_cancelled (task))
+        {
+            continue;
+        }
+
+        if (error != NULL)
+        {
+            g_task_return_error (task, g_error_copy (error));
+        }
+        else
+        {
+            g_task_return_pointer (task,
+                                   cairo_surface_reference (data->surface),
+                                   (GDestroyNotify) cairo_surface_destroy);
+        }
+    }
+
+    g_list_free_full (waiters, g_object_unref);
+    g_clear_error (&error);
+}
+
+static gchar *
+get_icon_path (const gchar *icon)
+{
+    if (g_path_is_absolute (icon))
+    {
+        return g_strdup (icon);
+    }
+
+    if (g_str_has_prefix (icon, "file://"))
+    {
+        return g_filename_from_uri (icon, NULL, NULL);
+    }
+
+    return NULL;
+}
+
+static void
+xapp_icon_surface_cache_init (XAppIconSurfaceCache *cache)
+{
+    GdkScreen *screen;
+
+    cache->max_entries = DEFAULT_MAX_ENTRIES;
+
+    g_queue_init (&cache->entries);
+    cache->index = g_hash_table_new (g_str_hash, g_str_equal);
+    cache->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    screen = gdk_screen_get_default ();
+
+    if (screen != NULL)
+    {
+        cache->theme = g_object_ref (gtk_icon_theme_get_for_screen (screen));
+        cache->theme_changed_id = g_signal_connect (cache->theme,
+                                                    "changed",
+                                                    G_CALLBACK (on_icon_theme_changed),
+                                                    cache);
+    }
+}
+
+static void
+xapp_icon_surface_cache_dispose (GObject *object)
+{
+    XAppIconSurfaceCache *cache = XAPP_ICON_SURFACE_CACHE (object);
+
+    DEBUG ("XAppIconSurfaceCache dispose (%p)", object);
+
+    if (cache->theme != NULL)
+    {
+        g_signal_handler_disconnect (cache->theme, cache->theme_changed_id);
+        cache->theme_changed_id = 0;
+
+        g_clear_object (&cache->theme);
+    }
+
+    if (cache->index != NULL)
+    {
+        g_queue_foreach (&cache->entries, (GFunc) cache_entry_free, NULL);
+        g_queue_clear (&cache->entries);
+
+        g_clear_pointer (&cache->index, g_hash_table_unref);
+    }
+
+    // Loads in progress hold a reference, so there's nothing waiting here.
+    g_clear_pointer (&cache->pending, g_hash_table_unref);
+
+    G_OBJECT_CLASS (xapp_icon_surface_cache_parent_class)->dispose (object);
+}
+
+static void
+xapp_icon_surface_cache_class_init (XAppIconSurfaceCacheClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+    gobject_class->dispose = xapp_icon_surface_cache_dispose;
+}
+
+/**
+ * xapp_icon_surface_cache_new:
+ * @max_entries: the most surfaces to keep, or 0 for the default.
+ *
+ * Creates a new cache. Most callers should use xapp_icon_surface_cache_get_default()
+ * instead, so surfaces can be shared.
+ *
+ * Returns: (transfer full): a new #XAppIconSurfaceCache. Use g_object_unref when finished.
+ *
+ * Since: 3.4
+ */
+XAppIconSurfaceCache *
+xapp_icon_surface_cache_new (guint max_entries)
+{
+    XAppIconSurfaceCache *cache = g_object_new (XAPP_TYPE_ICON_SURFACE_CACHE, NULL);
+
+    if (max_entries > 0)
+    {
+        cache->max_entries = max_entries;
+    }
+
+    return cache;
+}
+
+/**
+ * xapp_icon_surface_cache_get_default:
+ *
+ * Gets the process-wide cache.
+ *
+ * Returns: (transfer none): the default #XAppIconSurfaceCache.
+ *
+ * Since: 3.4
+ */
+XAppIconSurfaceCache *
+xapp_icon_surface_cache_get_default (void)
+{
+    if (default_cache == NULL)
+    {
+        default_cache = xapp_icon_surface_cache_new (0);
+    }
+
+    return default_cache;
+}
+
+/**
+ * xapp_icon_surface_cache_load_async:
+ * @cache: an #XAppIconSurfaceCache
+ * @icon: a themed icon name, or an absolute path or file:// uri
+ * @size: the size of the surface, in logical pixels
+ * @scale: the scale factor of the surface
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ * @callback: (scope async): the function to call with the result
+ * @user_data: (closure): data for @callback
+ *
+ * Gets a surface for @icon at @size and @scale. If it's cached (and, for files,
+ * still current) the result is available on the next main loop iteration -
+ * otherwise it's loaded on a worker thread first.
+ *
+ * Call xapp_icon_surface_cache_load_finish() from @callback to get the surface.
+ *
+ * Since: 3.4
+ */
+void
+xapp_icon_surface_cache_load_async (XAppIconSurfaceCache *cache,
+                                    const gchar          *icon,
+                                    gint                  size,
+                                    gint                  scale,
+                                    GCancellable         *cancellable,
+                                    GAsyncReadyCallback   callback,
+                                    gpointer              user_data)
+{
+    GTask *task, *load_task;
+    LoadData *data;
+    GList *link, *waiters;
+    gchar *key, *pending_key;
+
+    g_return_if_fail (XAPP_IS_ICON_SURFACE_CACHE (cache));
+    g_return_if_fail (icon != NULL);
+    g_return_if_fail (size > 0 && scale > 0);
+
+    task = g_task_new (cache, cancellable, callback, user_data);
+    g_task_set_source_tag (task, xapp_icon_surface_cache_load_async);
+
+    key = g_strdup_printf ("%s\n%d\n%d", icon, size, scale);
+
+    link = g_hash_table_lookup (cache->index, key);
+
+    if (link != NULL && !((CacheEntry *) link->data)->is_file)
+    {
+        CacheEntry *entry = link->data;
+
+        g_queue_unlink (&cache->entries, link);
+        g_queue_push_head_link (&cache->entries, link);
+
+        g_task_return_pointer (task,
+                               cairo_surface_reference (entry->surface),
+                               (GDestroyNotify) cairo_surface_destroy);
+
+        g_object_unref (task);
+        g_free (key);
+        return;
+    }
+
+    // Loads started before the theme changed won't be cached, and may have
+    // looked up the icon in the old theme, so only join current ones.
+    pending_key = g_strdup_printf ("%u\n%s", cache->generation, key);
+
+    if (g_hash_table_lookup_extended (cache->pending, pending_key, NULL, (gpointer *) &waiters))
+    {
+        // Already loading, wait for that.
+        g_hash_table_insert (cache->pending, pending_key, g_list_append (waiters, task));
+        g_free (key);
+        return;
+    }
+
+    data = g_slice_new0 (LoadData);
+    data->key = key;
+    data->pending_key = g_strdup (pending_key);
+    data->generation = cache->generation;
+    data->size = size;
+    data->scale = scale;
+    data->path = get_icon_path (icon);
+
+    if (data->path != NULL)
+    {
+        if (link != NULL)
+        {
+            CacheEntry *entry = link->data;
+
+            g_queue_unlink (&cache->entries, link);
+            g_queue_push_head_link (&cache->entries, link);
+
+            data->cached_surface = cairo_surface_reference (entry->surface);
+            data->cached_mtime = entry->mtime;
+            data->cached_mtime_usec = entry->mtime_usec;
+            data->cached_size = entry->size;
+        }
+    }
+    else
+    {
+        if (cache->theme != NULL)
+        {
+            data->info = gtk_icon_theme_lookup_icon_for_scale (cache->theme,
+                                                               icon,
+                                                               size,
+                                                               scale,
+                                                               GTK_ICON_LOOKUP_FORCE_SIZE);
+        }
+
+        if (data->info == NULL)
+        {
+            g_task_return_new_error (task,
+                                     G_IO_ERROR,
+                                     G_IO_ERROR_NOT_FOUND,
+                                     "Icon '%s' not found in the icon theme", icon);
+
+            load_data_free (data);
+            g_object_unref (task);
+            g_free (pending_key);
+            return;
+        }
+    }
+
+    g_hash_table_insert (cache->pending, pending_key, g_list_append (NULL, task));
+
+    load_task = g_task_new (cache, NULL, on_load_finished, NULL);
+    g_task_set_task_data (load_task, data, (GDestroyNotify) load_data_free);
+    g_task_run_in_thread (load_task, load_thread);
+    g_object_unref (load_task);
+}
+
+/**
+ * xapp_icon_surface_cache_load_finish:
+ * @cache: an #XAppIconSurfaceCache
+ * @result: the #GAsyncResult passed to the callback
+ * @error: (nullable): a #GError, or %NULL
+ *
+ * Finishes xapp_icon_surface_cache_load_async().
+ *
+ * Returns: (transfer full) (nullable): the icon's surface, or %NULL if it
+ * couldn't be loaded. The surface is shared with the cache - don't draw on it.
+ *
+ * Since: 3.4
+ */
+cairo_surface_t *
+xapp_icon_surface_cache_load_finish (XAppIconSurfaceCache *cache,
+                                     GAsyncResult         *result,
+                                     GError              **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, cache), NULL);
+
+    return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/**
+ * xapp_icon_surface_cache_invalidate:
+ * @cache: an #XAppIconSurfaceCache
+ *
+ * Drops everything in the cache, and makes sure nothing already being
+ * loaded ends up in it.
+ *
+ * Since: 3.4
+ */
+void
+xapp_icon_surface_cache_invalidate (XAppIconSurfaceCache *cache)
+{
+    g_return_if_fail (XAPP_IS_ICON_SURFACE_CACHE (cache));
+
+    clear_entries (cache, FALSE);
+}
@@ -0,0 +1,32 @@
+#ifndef __XAPP_ICON_SURFACE_CACHE_H__
+#define __XAPP_ICON_SURFACE_CACHE_H__
+
+#include <stdio.h>
+#include <gtk/gtk.h>
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define XAPP_TYPE_ICON_SURFACE_CACHE (xapp_icon_surface_cache_get_type ())
+G_DECLARE_FINAL_TYPE (XAppIconSurfaceCache, xapp_icon_surface_cache, XAPP, ICON_SURFACE_CACHE, GObject)
+
+XAppIconSurfaceCache *xapp_icon_surface_cache_new         (guint max_entries);
+XAppIconSurfaceCache *xapp_icon_surface_cache_get_default (void);
+
+void                  xapp_icon_surface_cache_load_async  (XAppIconSurfaceCache *cache,
+                                                           const gchar          *icon,
+                                                           gint                  size,
+                                                           gint                  scale,
+                                                           GCancellable         *cancellable,
+                                                           GAsyncReadyCallback   callback,
+                                                           gpointer              user_data);
+cairo_surface_t      *xapp_icon_surface_cache_load_finish (XAppIconSurfaceCache *cache,
+                                                           GAsyncResult         *result,
+                                                           GError              **error);
+
+void                  xapp_icon_surface_cache_invalidate  (XAppIconSurfaceCache *cache);
+
+G_END_DECLS
+
+#endif  /* __XAPP_ICON_SURFACE_CACHE_H__ */
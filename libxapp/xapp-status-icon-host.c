@@ -0,0 +1,1199 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include <glib/gi18n-lib.h>
+
+#include "xapp-status-icon-host.h"
+#include "xapp-icon-surface-cache.h"
+#include "xapp-statusicon-interface.h"
+#include "xapp-enums.h"
+
+#define DEBUG_FLAG XAPP_DEBUG_STATUS_ICON
+#include "xapp-debug.h"
+
+#define DEFAULT_ICON_SIZE 24
+#define STATUS_ICON_NAME_PREFIX "org.x.StatusIcon."
+
+/**
+ * SECTION:xapp-status-icon-host
+ * @Short_description: A widget that shows the icons an #XAppStatusIconMonitor finds.
+ * @Title: XAppStatusIconHost
+ *
+ * The XAppStatusIconHost is a ready-made status applet body. Give it an
+ * #XAppStatusIconMonitor, and it shows a button for each icon, with its icon,
+ * label and tooltip, and passes clicks and scrolls on to the app.
+ *
+ * Icons are ordered the way the XApp status applets do it - full color icons
+ * first, then symbolic ones, each sorted by name. Only the icon that changed is
+ * moved when an icon is added or renamed.
+ *
+ * Icons are loaded through xapp_icon_surface_cache_get_default(), except themed
+ * symbolic icons, which are left to #GtkImage so they're recolored to match the
+ * panel. Only the IconName is shown - animations and raw pixels are not.
+ *
+ * When an app restarts, its icons are handed over to their existing buttons (see
+ * #XAppStatusIconMonitor::icon-replaced), rather than removed and added again.
+ *
+ * Since: 3.4
+ */
+
+typedef struct
+{
+    XAppStatusIconHost *host;
+    XAppStatusIconInterface *proxy;
+
+    GtkWidget *button;
+    GtkWidget *image;
+    GtkWidget *label;
+
+    gchar *sort_key;
+    gboolean symbolic;
+
+    GCancellable *icon_cancellable;
+
+    gboolean menu_opened;
+    gboolean highlight_both_menus;
+
+    // For icons that take a whole click at once, the press waiting for its release.
+    guint press_button;
+    guint press_time;
+
+    // Scrolling not yet sent, in steps - sent at most once per frame.
+    gdouble scroll_dx;
+    gdouble scroll_dy;
+    guint scroll_time;
+    guint scroll_tick_id;
+} HostItem;
+
+typedef struct
+{
+    XAppStatusIconMonitor *monitor;
+
+    gulong icon_added_id;
+    gulong icon_removed_id;
+    gulong icon_changed_id;
+    gulong icon_replaced_id;
+
+    GtkIconTheme *icon_theme;
+    gulong icon_theme_changed_id;
+
+    GPtrArray *items;             // HostItem, in display order
+    GHashTable *items_by_proxy;   // proxy -> HostItem (owned)
+
+    gint icon_size;
+    GtkPositionType panel_position;
+} XAppStatusIconHostPrivate;
+
+struct _XAppStatusIconHost
+{
+    GtkBox parent_instance;
+};
+
+enum
+{
+    PROP_0,
+    PROP_MONITOR,
+    PROP_ICON_SIZE,
+    PROP_PANEL_POSITION,
+    N_PROPERTIES
+};
+
+static GParamSpec *obj_properties[N_PROPERTIES] = { NULL, };
+
+G_DEFINE_TYPE_WITH_PRIVATE (XAppStatusIconHost, xapp_status_icon_host, GTK_TYPE_BOX)
+
+static void
+host_item_free (HostItem *item)
+{
+    if (item->icon_cancellable != NULL)
+    {
+        g_cancellable_cancel (item->icon_cancellable);
+        g_object_unref (item->icon_cancellable);
+    }
+
+    g_object_unref (item->proxy);
+    g_free (item->sort_key);
+
+    g_slice_free (HostItem, item);
+}
+
+static gint
+compare_items (HostItem *a,
+               HostItem *b)
+{
+    if (a->symbolic != b->symbolic)
+    {
+        return a->symbolic ? 1 : -1;
+    }
+
+    return g_strcmp0 (a->sort_key, b->sort_key);
+}
+
+static void
+update_sort_key (HostItem *item)
+{
+    const gchar *name;
+    const gchar *icon_name;
+    gchar *folded;
+
+    name = xapp_status_icon_interface_get_name (item->proxy);
+
+    if (name == NULL)
+    {
+        name = "";
+    }
+
+    if (g_str_has_prefix (name, STATUS_ICON_NAME_PREFIX))
+    {
+        name += strlen (STATUS_ICON_NAME_PREFIX);
+    }
+
+    folded = g_utf8_casefold (name, -1);
+    g_free (item->sort_key);
+    item->sort_key = g_utf8_collate_key (folded, -1);
+    g_free (folded);
+
+    icon_name = xapp_status_icon_interface_get_icon_name (item->proxy);
+
+    if (icon_name != NULL)
+    {
+        gchar *lower = g_ascii_strdown (icon_name, -1);
+        item->symbolic = g_str_has_suffix (lower, "symbolic");
+        g_free (lower);
+    }
+    else
+    {
+        item->symbolic = FALSE;
+    }
+}
+
+/* Moves just this item to where it belongs - everything else is in order already. */
+static void
+position_item (XAppStatusIconHost *host,
+               HostItem           *item)
+{
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (host);
+    guint old_index = G_MAXUINT;
+    guint lo, hi, i;
+
+    for (i = 0; i < priv->items->len; i++)
+    {
+        if (g_ptr_array_index (priv->items, i) == item)
+        {
+            old_index = i;
+            g_ptr_array_remove_index (priv->items, i);
+            break;
+        }
+    }
+
+    lo = 0;
+    hi = priv->items->len;
+
+    while (lo < hi)
+    {
+        guint mid = (lo + hi) / 2;
+
+        if (compare_items (g_ptr_array_index (priv->items, mid), item) <= 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    g_ptr_array_insert (priv->items, lo, item);
+
+    if (lo != old_index)
+    {
+        gtk_box_reorder_child (GTK_BOX (host), item->button, lo);
+    }
+}
+
+static void
+on_icon_loaded (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+    HostItem *item;
+    cairo_surface_t *surface;
+    GError *error = NULL;
+
+    surface = xapp_icon_surface_cache_load_finish (XAPP_ICON_SURFACE_CACHE (source), res, &error);
+
+    if (surface == NULL)
+    {
+        // The item may be gone already.
+        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+            g_error_free (error);
+            return;
+        }
+
+        item = user_data;
+
+        DEBUG ("Could not load icon for %s: %s",
+               xapp_status_icon_interface_get_name (item->proxy), error->message);
+        g_error_free (error);
+
+        gtk_image_set_from_icon_name (GTK_IMAGE (item->image), "image-missing", GTK_ICON_SIZE_MENU);
+        return;
+    }
+
+    item = user_data;
+
+    gtk_image_set_from_surface (GTK_IMAGE (item->image), surface);
+    cairo_surface_destroy (surface);
+}
+
+/* The same icons the cache loads from a file, rather than the theme. */
+static gboolean
+is_icon_path (const gchar *icon_name)
+{
+    return g_path_is_absolute (icon_name) || g_str_has_prefix (icon_name, "file://");
+}
+
+static void
+update_icon (HostItem *item)
+{
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (item->host);
+    const gchar *icon_name;
+
+    if (item->icon_cancellable != NULL)
+    {
+        g_cancellable_cancel (item->icon_cancellable);
+        g_clear_object (&item->icon_cancellable);
+    }
+
+    gtk_image_set_pixel_size (GTK_IMAGE (item->image), priv->icon_size);
+
+    icon_name = xapp_status_icon_interface_get_icon_name (item->proxy);
+
+    if (icon_name == NULL || icon_name[0] == '\0')
+    {
+        gtk_image_set_from_icon_name (GTK_IMAGE (item->image), "image-missing", GTK_ICON_SIZE_MENU);
+        return;
+    }
+
+    if (item->symbolic && !is_icon_path (icon_name))
+    {
+        gtk_image_set_from_icon_name (GTK_IMAGE (item->image), icon_name, GTK_ICON_SIZE_MENU);
+        return;
+    }
+
+    item->icon_cancellable = g_cancellable_new ();
+
+    xapp_icon_surface_cache_load_async (xapp_icon_surface_cache_get_default (),
+                                        icon_name,
+                                        priv->icon_size,
+                                        gtk_widget_get_scale_factor (GTK_WIDGET (item->host)),
+                                        item->icon_cancellable,
+                                        on_icon_loaded,
+                                        item);
+}
+
+static void
+update_label (HostItem *item)
+{
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (item->host);
+    const gchar *label;
+    gboolean horizontal;
+
+    label = xapp_status_icon_interface_get_label (item->proxy);
+    horizontal = priv->panel_position == GTK_POS_TOP || priv->panel_position == GTK_POS_BOTTOM;
+
+    gtk_label_set_text (GTK_LABEL (item->label), label != NULL ? label : "");
+    gtk_widget_set_visible (item->label, horizontal && label != NULL && label[0] != '\0');
+}
+
+static void
+update_tooltip (HostItem *item)
+{
+    const gchar *tooltip = xapp_status_icon_interface_get_tooltip_text (item->proxy);
+
+    gtk_widget_set_tooltip_markup (item->button,
+                                   tooltip != NULL && tooltip[0] != '\0' ? tooltip : NULL);
+}
+
+static void
+update_visible (HostItem *item)
+{
+    gtk_widget_set_visible (item->button, xapp_status_icon_interface_get_visible (item->proxy));
+}
+
+static void
+update_menu_state (HostItem *item)
+{
+    gboolean open;
+
+    open = xapp_status_icon_interface_get_primary_menu_is_open (item->proxy) ||
+           xapp_status_icon_interface_get_secondary_menu_is_open (item->proxy);
+
+    // Only show the button as active for menus it opened itself.
+    if (!item->menu_opened || !open)
+    {
+        gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (item->button), FALSE);
+        return;
+    }
+
+    gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (item->button), TRUE);
+    item->menu_opened = FALSE;
+}
+
+static void
+update_metadata (HostItem *item)
+{
+    const gchar *metadata;
+    GVariant *dict, *value;
+
+    item->highlight_both_menus = FALSE;
+
+    metadata = xapp_status_icon_interface_get_metadata (item->proxy);
+
+    if (metadata == NULL || metadata[0] == '\0')
+    {
+        return;
+    }
+
+    /* The metadata is a JSON object. The simple ones apps use here
+     * ({"highlight-both-menus": true}) are valid GVariant text too. */
+    dict = g_variant_parse (NULL, metadata, NULL, NULL, NULL);
+
+    if (dict == NULL)
+    {
+        DEBUG ("Could not read metadata for %s: %s",
+               xapp_status_icon_interface_get_name (item->proxy), metadata);
+        return;
+    }
+
+    if (g_variant_is_of_type (dict, G_VARIANT_TYPE ("a{s*}")))
+    {
+        value = g_variant_lookup_value (dict, "highlight-both-menus", G_VARIANT_TYPE_BOOLEAN);
+
+        if (value != NULL)
+        {
+            item->highlight_both_menus = g_variant_get_boolean (value);
+            g_variant_unref (value);
+        }
+    }
+
+    g_variant_unref (dict);
+}
+
+static void
+get_menu_origin (HostItem *item,
+                 gint     *x,
+                 gint     *y)
+{
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (item->host);
+    GtkAllocation alloc;
+    gint ox, oy;
+
+    gtk_widget_get_allocation (item->button, &alloc);
+    gdk_window_get_origin (gtk_widget_get_window (item->button), &ox, &oy);
+
+    switch (priv->panel_position)
+    {
+        case GTK_POS_TOP:
+            *x = ox + alloc.x;
+            *y = oy + alloc.y + alloc.height;
+            break;
+        case GTK_POS_LEFT:
+            *x = ox + alloc.x + alloc.width;
+            *y = oy + alloc.y;
+            break;
+        case GTK_POS_RIGHT:
+        case GTK_POS_BOTTOM:
+        default:
+            *x = ox + alloc.x;
+            *y = oy + alloc.y;
+            break;
+    }
+}
+
+static gboolean
+on_button_press (GtkWidget      *widget,
+                 GdkEventButton *event,
+                 HostItem       *item)
+{
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (item->host);
+    gint x, y;
+
+    item->menu_opened = FALSE;
+
+    // Ctrl-right-click is left for the panel's own applet menu.
+    if ((event->state & GDK_CONTROL_MASK) && event->button == GDK_BUTTON_SECONDARY)
+    {
+        return GDK_EVENT_PROPAGATE;
+    }
+
+    // The second press of a double-click was already sent on its own.
+    if (event->type != GDK_BUTTON_PRESS)
+    {
+        return GDK_EVENT_STOP;
+    }
+
+    if (xapp_status_icon_interface_get_supports_click (item->proxy))
+    {
+        item->press_button = event->button;
+        item->press_time = event->time;
+
+        return GDK_EVENT_STOP;
+    }
+
+    get_menu_origin (item, &x, &y);
+
+    xapp_status_icon_interface_call_button_press (item->proxy,
+                                                  x, y,
+                                                  event->button,
+                                                  event->time,
+                                                  priv->panel_position,
+                                                  NULL, NULL, NULL);
+
+    // This also keeps the panel's own menu and middle-click drag away from the icon.
+    return GDK_EVENT_STOP;
+}
+
+static gboolean
+on_button_release (GtkWidget      *widget,
+                   GdkEventButton *event,
+                   HostItem       *item)
+{
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (item->host);
+    gint x, y;
+
+    if (event->button == GDK_BUTTON_PRIMARY ||
+        (event->button == GDK_BUTTON_SECONDARY && item->highlight_both_menus))
+    {
+        item->menu_opened = TRUE;
+    }
+
+    get_menu_origin (item, &x, &y);
+
+    if (xapp_status_icon_interface_get_supports_click (item->proxy))
+    {
+        // No press, no click - the icon would have ignored this release too.
+        if (item->press_button == event->button)
+        {
+            xapp_status_icon_interface_call_click (item->proxy,
+                                                   x, y,
+                                                   event->button,
+                                                   item->press_time,
+                                                   event->time,
+                                                   priv->panel_position,
+                                                   NULL, NULL, NULL);
+        }
+
+        item->press_button = 0;
+
+        return GDK_EVENT_PROPAGATE;
+    }
+
+    xapp_status_icon_interface_call_button_release (item->proxy,
+                                                    x, y,
+                                                    event->button,
+                                                    event->time,
+                                                    priv->panel_position,
+                                                    NULL, NULL, NULL);
+
+    return GDK_EVENT_PROPAGATE;
+}
+
+static void
+send_scroll_steps (HostItem            *item,
+                   gdouble             *pending,
+                   XAppScrollDirection  negative,
+                   XAppScrollDirection  positive)
+{
+    gint steps = (gint) *pending;
+    gint i;
+
+    // Partial steps from smooth scrolling wait for the rest.
+    if (steps == 0)
+    {
+        return;
+    }
+
+    *pending -= steps;
+
+    if (xapp_status_icon_interface_get_supports_scroll_coalescing (item->proxy))
+    {
+        xapp_status_icon_interface_call_scroll (item->proxy,
+                                                steps,
+                                                steps < 0 ? negative : positive,
+                                                item->scroll_time,
+                                                NULL, NULL, NULL);
+        return;
+    }
+
+    // Other apps expect one step at a time.
+    for (i = 0; i < ABS (steps); i++)
+    {
+        xapp_status_icon_interface_call_scroll (item->proxy,
+                                                steps < 0 ? -1 : 1,
+                                                steps < 0 ? negative : positive,
+                                                item->scroll_time,
+                                                NULL, NULL, NULL);
+    }
+}
+
+static gboolean
+flush_scroll (GtkWidget     *widget,
+              GdkFrameClock *frame_clock,
+              gpointer       user_data)
+{
+    HostItem *item = user_data;
+
+    item->scroll_tick_id = 0;
+
+    send_scroll_steps (item, &item->scroll_dy, XAPP_SCROLL_UP, XAPP_SCROLL_DOWN);
+    send_scroll_steps (item, &item->scroll_dx, XAPP_SCROLL_LEFT, XAPP_SCROLL_RIGHT);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+on_scroll (GtkWidget      *widget,
+           GdkEventScroll *event,
+           HostItem       *item)
+{
+    gdouble dx, dy;
+
+    switch (event->direction)
+    {
+        case GDK_SCROLL_UP:
+            item->scroll_dy -= 1;
+            break;
+        case GDK_SCROLL_DOWN:
+            item->scroll_dy += 1;
+            break;
+        case GDK_SCROLL_LEFT:
+            item->scroll_dx -= 1;
+            break;
+        case GDK_SCROLL_RIGHT:
+            item->scroll_dx += 1;
+            break;
+        case GDK_SCROLL_SMOOTH:
+            if (gdk_event_get_scroll_deltas ((GdkEvent *) event, &dx, &dy))
+            {
+                item->scroll_dx += dx;
+                item->scroll_dy += dy;
+            }
+            break;
+        default:
+            break;
+    }
+
+    item->scroll_time = event->time;
+
+    if (item->scroll_tick_id == 0)
+    {
+        item->scroll_tick_id = gtk_widget_add_tick_callback (item->button, flush_scroll, item, NULL);
+    }
+
+    return GDK_EVENT_STOP;
+}
+
+static void
+add_item (XAppStatusIconHost      *host,
+          XAppStatusIconInterface *proxy)
+{
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (host);
+    HostItem *item;
+    GtkWidget *box;
+
+    if (g_hash_table_contains (priv->items_by_proxy, proxy))
+    {
+        return;
+    }
+
+    DEBUG ("Adding icon: %s", xapp_status_icon_interface_get_name (proxy));
+
+    item = g_slice_new0 (HostItem);
+    item->host = host;
+    item->proxy = g_object_ref (proxy);
+
+    item->button = gtk_toggle_button_new ();
+    gtk_button_set_relief (GTK_BUTTON (item->button), GTK_RELIEF_NONE);
+    gtk_widget_set_can_focus (item->button, FALSE);
+    gtk_widget_set_can_default (item->button, FALSE);
+    gtk_widget_set_focus_on_click (item->button, FALSE);
+    gtk_widget_add_events (item->button, GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK);
+
+    box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0);
+    item->image = gtk_image_new ();
+    gtk_widget_set_hexpand (item->image, TRUE);
+    item->label = gtk_label_new (NULL);
+    gtk_widget_set_no_show_all (item->label, TRUE);
+
+    gtk_box_pack_start (GTK_BOX (box), item->image, TRUE, FALSE, 0);
+    gtk_box_pack_start (GTK_BOX (box), item->label, FALSE, FALSE, 0);
+    gtk_container_add (GTK_CONTAINER (item->button), box);
+    gtk_widget_show_all (box);
+
+    g_signal_connect (item->button, "button-press-event", G_CALLBACK (on_button_press), item);
+    g_signal_connect (item->button, "button-release-event", G_CALLBACK (on_button_release), item);
+    g_signal_connect (item->button, "scroll-event", G_CALLBACK (on_scroll), item);
+
+    gtk_container_add (GTK_CONTAINER (host), item->button);
+    g_hash_table_insert (priv->items_by_proxy, proxy, item);
+
+    update_sort_key (item);
+    position_item (host, item);
+
+    xapp_status_icon_interface_set_icon_size (proxy, priv->icon_size);
+
+    update_icon (item);
+    update_label (item);
+    update_tooltip (item);
+    update_metadata (item);
+    update_menu_state (item);
+    update_visible (item);
+}
+
+static void
+remove_item (XAppStatusIconHost      *host,
+             XAppStatusIconInterface *proxy)
+{
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (host);
+    HostItem *item;
+
+    item = g_hash_table_lookup (priv->items_by_proxy, proxy);
+
+    if (item == NULL)
+    {
+        return;
+    }
+
+    DEBUG ("Removing icon: %s", xapp_status_icon_interface_get_name (proxy));
+
+    g_ptr_array_remove (priv->items, item);
+    gtk_widget_destroy (item->button);
+
+    g_hash_table_remove (priv->items_by_proxy, proxy);
+}
+
+static void
+on_icon_added (XAppStatusIconMonitor *monitor,
+               XAppStatusIconInterfaceProxy *proxy,
+               XAppStatusIconHost    *host)
+{
+    add_item (host, XAPP_STATUS_ICON_INTERFACE (proxy));
+}
+
+static void
+on_icon_removed (XAppStatusIconMonitor *monitor,
+                 XAppStatusIconInterfaceProxy *proxy,
+                 XAppStatusIconHost    *host)
+{
+    remove_item (host, XAPP_STATUS_ICON_INTERFACE (proxy));
+}
+
+static void
+on_icon_replaced (XAppStatusIconMonitor        *monitor,
+                  XAppStatusIconInterfaceProxy *old_proxy,
+                  XAppStatusIconInterfaceProxy *new_proxy,
+                  XAppStatusIconHost           *host)
+{
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (host);
+    HostItem *item;
+
+    item = g_hash_table_lookup (priv->items_by_proxy, old_proxy);
+
+    if (item == NULL)
+    {
+        add_item (host, XAPP_STATUS_ICON_INTERFACE (new_proxy));
+        return;
+    }
+
+    DEBUG ("Icon came back: %s", xapp_status_icon_interface_get_name (XAPP_STATUS_ICON_INTERFACE (new_proxy)));
+
+    // The app restarted - keep the button, and point it at the new instance.
+    g_hash_table_steal (priv->items_by_proxy, old_proxy);
+    g_object_unref (item->proxy);
+
+    item->proxy = g_object_ref (XAPP_STATUS_ICON_INTERFACE (new_proxy));
+    g_hash_table_insert (priv->items_by_proxy, item->proxy, item);
+
+    item->press_button = 0;
+    item->menu_opened = FALSE;
+
+    xapp_status_icon_interface_set_icon_size (item->proxy, priv->icon_size);
+
+    update_sort_key (item);
+    position_item (host, item);
+
+    update_icon (item);
+    update_label (item);
+    update_tooltip (item);
+    update_metadata (item);
+    update_menu_state (item);
+    update_visible (item);
+}
+
+static void
+on_icon_changed (XAppStatusIconMonitor        *monitor,
+                 XAppStatusIconInterfaceProxy *proxy,
+                 XAppStatusIconChange          changes,
+                 XAppStatusIconHost           *host)
+{
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (host);
+    HostItem *item;
+
+    item = g_hash_table_lookup (priv->items_by_proxy, proxy);
+
+    if (item == NULL)
+    {
+        return;
+    }
+
+    if (changes & (XAPP_STATUS_ICON_CHANGE_NAME | XAPP_STATUS_ICON_CHANGE_ICON_NAME))
+    {
+        update_sort_key (item);
+        position_item (host, item);
+    }
+
+    if (changes & XAPP_STATUS_ICON_CHANGE_ICON_NAME)
+    {
+        update_icon (item);
+    }
+
+    if (changes & XAPP_STATUS_ICON_CHANGE_LABEL)
+    {
+        update_label (item);
+    }
+
+    if (changes & XAPP_STATUS_ICON_CHANGE_TOOLTIP_TEXT)
+    {
+        update_tooltip (item);
+    }
+
+    if (changes & XAPP_STATUS_ICON_CHANGE_METADATA)
+    {
+        update_metadata (item);
+    }
+
+    if (changes & XAPP_STATUS_ICON_CHANGE_MENU_STATE)
+    {
+        update_menu_state (item);
+    }
+
+    if (changes & XAPP_STATUS_ICON_CHANGE_VISIBLE)
+    {
+        update_visible (item);
+    }
+}
+
+static void
+update_all_icons (XAppStatusIconHost *host)
+{
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (host);
+    guint i;
+
+    for (i = 0; i < priv->items->len; i++)
+    {
+        update_icon (g_ptr_array_index (priv->items, i));
+    }
+}
+
+static void
+on_scale_factor_changed (GObject    *object,
+                         GParamSpec *pspec,
+                         gpointer    user_data)
+{
+    update_all_icons (XAPP_STATUS_ICON_HOST (object));
+}
+
+/* Connected after the cache's own handler, so it has already dropped the
+ * old theme's icons. GtkImage takes care of the symbolic ones by itself. */
+static void
+on_icon_theme_changed (GtkIconTheme *theme,
+                       gpointer      user_data)
+{
+    DEBUG ("Icon theme changed, reloading icons");
+
+    update_all_icons (XAPP_STATUS_ICON_HOST (user_data));
+}
+
+static void
+xapp_status_icon_host_get_property (GObject    *object,
+                                    guint       prop_id,
+                                    GValue     *value,
+                                    GParamSpec *pspec)
+{
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (XAPP_STATUS_ICON_HOST (object));
+
+    switch (prop_id)
+    {
+        case PROP_MONITOR:
+            g_value_set_object (value, priv->monitor);
+            break;
+        case PROP_ICON_SIZE:
+            g_value_set_int (value, priv->icon_size);
+            break;
+        case PROP_PANEL_POSITION:
+            g_value_set_enum (value, priv->panel_position);
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+            break;
+    }
+}
+
+static void
+xapp_status_icon_host_set_property (GObject      *object,
+                                    guint         prop_id,
+                                    const GValue *value,
+                                    GParamSpec   *pspec)
+{
+    XAppStatusIconHost *host = XAPP_STATUS_ICON_HOST (object);
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (host);
+
+    switch (prop_id)
+    {
+        case PROP_MONITOR:
+            priv->monitor = g_value_dup_object (value);
+            break;
+        case PROP_ICON_SIZE:
+            xapp_status_icon_host_set_icon_size (host, g_value_get_int (value));
+            break;
+        case PROP_PANEL_POSITION:
+            xapp_status_icon_host_set_panel_position (host, g_value_get_enum (value));
+            break;
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+            break;
+    }
+}
+
+static void
+xapp_status_icon_host_init (XAppStatusIconHost *host)
+{
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (host);
+
+    priv->items = g_ptr_array_new ();
+    priv->items_by_proxy = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                  NULL, (GDestroyNotify) host_item_free);
+
+    priv->icon_size = DEFAULT_ICON_SIZE;
+    priv->panel_position = GTK_POS_BOTTOM;
+
+    g_signal_connect (host, "notify::scale-factor", G_CALLBACK (on_scale_factor_changed), NULL);
+
+    if (gdk_screen_get_default () != NULL)
+    {
+        priv->icon_theme = g_object_ref (gtk_icon_theme_get_for_screen (gdk_screen_get_default ()));
+        priv->icon_theme_changed_id = g_signal_connect_after (priv->icon_theme,
+                                                              "changed",
+                                                              G_CALLBACK (on_icon_theme_changed),
+                                                              host);
+    }
+}
+
+static void
+xapp_status_icon_host_constructed (GObject *object)
+{
+    XAppStatusIconHost *host = XAPP_STATUS_ICON_HOST (object);
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (host);
+    guint i, n_items;
+
+    G_OBJECT_CLASS (xapp_status_icon_host_parent_class)->constructed (object);
+
+    g_return_if_fail (XAPP_IS_STATUS_ICON_MONITOR (priv->monitor));
+
+    priv->icon_added_id = g_signal_connect (priv->monitor, "icon-added",
+                                            G_CALLBACK (on_icon_added), host);
+    priv->icon_removed_id = g_signal_connect (priv->monitor, "icon-removed",
+                                              G_CALLBACK (on_icon_removed), host);
+    priv->icon_changed_id = g_signal_connect (priv->monitor, "icon-changed",
+                                              G_CALLBACK (on_icon_changed), host);
+    priv->icon_replaced_id = g_signal_connect (priv->monitor, "icon-replaced",
+                                               G_CALLBACK (on_icon_replaced), host);
+
+    // Pick up whatever the monitor has already found.
+    n_items = g_list_model_get_n_items (G_LIST_MODEL (priv->monitor));
+
+    for (i = 0; i < n_items; i++)
+    {
+        XAppStatusIconInterface *proxy = g_list_model_get_item (G_LIST_MODEL (priv->monitor), i);
+
+        add_item (host, proxy);
+        g_object_unref (proxy);
+    }
+}
+
+static void
+xapp_status_icon_host_dispose (GObject *object)
+{
+    XAppStatusIconHost *host = XAPP_STATUS_ICON_HOST (object);
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (host);
+
+    DEBUG ("XAppStatusIconHost dispose (%p)", object);
+
+    if (priv->monitor != NULL)
+    {
+        g_signal_handler_disconnect (priv->monitor, priv->icon_added_id);
+        g_signal_handler_disconnect (priv->monitor, priv->icon_removed_id);
+        g_signal_handler_disconnect (priv->monitor, priv->icon_changed_id);
+        g_signal_handler_disconnect (priv->monitor, priv->icon_replaced_id);
+
+        g_clear_object (&priv->monitor);
+    }
+
+    if (priv->icon_theme != NULL)
+    {
+        g_signal_handler_disconnect (priv->icon_theme, priv->icon_theme_changed_id);
+        g_clear_object (&priv->icon_theme);
+    }
+
+    if (priv->items_by_proxy != NULL)
+    {
+        guint i;
+
+        // The buttons' handlers point at their items, so they go first.
+        for (i = 0; i < priv->items->len; i++)
+        {
+            HostItem *item = g_ptr_array_index (priv->items, i);
+            gtk_widget_destroy (item->button);
+        }
+
+        g_ptr_array_set_size (priv->items, 0);
+        g_clear_pointer (&priv->items_by_proxy, g_hash_table_unref);
+    }
+
+    G_OBJECT_CLASS (xapp_status_icon_host_parent_class)->dispose (object);
+}
+
+static void
+xapp_status_icon_host_finalize (GObject *object)
+{
+    XAppStatusIconHostPrivate *priv = xapp_status_icon_host_get_instance_private (XAPP_STATUS_ICON_HOST (object));
+
+    g_ptr_array_unref (priv->items);
+
+    G_OBJECT_CLASS (xapp_status_icon_host_parent_class)->finalize (object);
+}
+
+static void
+xapp_status_icon_host_class_init (XAppStatusIconHostClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    object_class->get_property = xapp_status_icon_host_get_property;
+    object_class->set_property = xapp_status_icon_host_set_property;
+    object_class->constructed = xapp_status_icon_host_constructed;
+    object_class->dispose = xapp_status_icon_host_dispose;
+    object_class->finalize = xapp_status_icon_host_finalize;
+
+    /**
+     * XAppStatusIconHost:monitor:
+     *
+     * The #XAppStatusIconMonitor whose icons are shown.
+     */
+    obj_properties[PROP_MONITOR] =
+        g_param_spec_object ("monitor",
+                             _("Monitor"),
+                             _("The status icon monitor whose icons are shown."),
+                             XAPP_TYPE_STATUS_ICON_MONITOR,
+                             G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+    /**
+     * XAppStatusIconHost:icon-size:
+     *
+     * The size of the icons, in logical pixels. This is also passed on to the
+     * apps, for those that draw their own icons.
+     */
+    obj_properties[PROP_ICON_SIZE] =
+        g_param_spec_int ("icon-size",
+                          _("Icon size"),
+                          _("The size of the icons."),
+                          1, G_MAXINT, DEFAULT_ICON_SIZE,
+                          G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+    /**
+     * XAppStatusIconHost:panel-position:
+     *
+     * Which edge of the screen the panel holding this is on. This sets the
+     * host's orientation, and where apps position their menus.
+     */
+    obj_properties[PROP_PANEL_POSITION] =
+        g_param_spec_enum ("panel-position",
+                           _("Panel position"),
+                           _("The screen edge of the panel holding the icons."),
+                           GTK_TYPE_POSITION_TYPE,
+                           GTK_POS_BOTTOM,
+                           G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+    g_object_class_install_properties (object_class, N_PROPERTIES, obj_properties);
+}
+
+/**
+ * xapp_status_icon_host_new:
+ * @monitor: the #XAppStatusIconMonitor whose icons to show.
+ *
+ * Creates a new host for @monitor's icons.
+ *
+ * Returns: (transfer full): a new #XAppStatusIconHost.
+ *
+ * Since: 3.4
+ */
+GtkWidget *
+xapp_status_icon_host_new (XAppStatusIconMonitor *monitor)
+{
+    g_return_val_if_fail (XAPP_IS_STATUS_ICON_MONITOR (monitor), NULL);
+
+    return g_object_new (XAPP_TYPE_STATUS_ICON_HOST,
+                         "monitor", monitor,
+                         NULL);
+}
+
+/**
+ * xapp_status_icon_host_get_monitor:
+ * @host: an #XAppStatusIconHost
+ *
+ * Gets the monitor whose icons @host shows.
+ *
+ * Returns: (transfer none): the #XAppStatusIconMonitor.
+ *
+ * Since: 3.4
+ */
+XAppStatusIconMonitor *
+xapp_status_icon_host_get_monitor (XAppStatusIconHost *host)
+{
+    XAppStatusIconHostPrivate *priv;
+
+    g_return_val_if_fail (XAPP_IS_STATUS_ICON_HOST (host), NULL);
+
+    priv = xapp_status_icon_host_get_instance_private (host);
+
+    return priv->monitor;
+}
+
+/**
+ * xapp_status_icon_host_set_icon_size:
+ * @host: an #XAppStatusIconHost
+ * @icon_size: the icon size, in logical pixels.
+ *
+ * Sets the size of the icons.
+ *
+ * Since: 3.4
+ */
+void
+xapp_status_icon_host_set_icon_size (XAppStatusIconHost *host,
+                                     gint                icon_size)
+{
+    XAppStatusIconHostPrivate *priv;
+    guint i;
+
+    g_return_if_fail (XAPP_IS_STATUS_ICON_HOST (host));
+    g_return_if_fail (icon_size > 0);
+
+    priv = xapp_status_icon_host_get_instance_private (host);
+
+    if (priv->icon_size == icon_size)
+    {
+        return;
+    }
+
+    priv->icon_size = icon_size;
+
+    for (i = 0; i < priv->items->len; i++)
+    {
+        HostItem *item = g_ptr_array_index (priv->items, i);
+
+        xapp_status_icon_interface_set_icon_size (item->proxy, icon_size);
+        update_icon (item);
+    }
+
+    g_object_notify_by_pspec (G_OBJECT (host), obj_properties[PROP_ICON_SIZE]);
+}
+
+/**
+ * xapp_status_icon_host_get_icon_size:
+ * @host: an #XAppStatusIconHost
+ *
+ * Gets the size of the icons.
+ *
+ * Returns: the icon size, in logical pixels.
+ *
+ * Since: 3.4
+ */
+gint
+xapp_status_icon_host_get_icon_size (XAppStatusIconHost *host)
+{
+    XAppStatusIconHostPrivate *priv;
+
+    g_return_val_if_fail (XAPP_IS_STATUS_ICON_HOST (host), DEFAULT_ICON_SIZE);
+
+    priv = xapp_status_icon_host_get_instance_private (host);
+
+    return priv->icon_size;
+}
+
+/**
+ * xapp_status_icon_host_set_panel_position:
+ * @host: an #XAppStatusIconHost
+ * @position: the screen edge the panel is on.
+ *
+ * Tells @host where its panel is. Icons are laid out vertically on
+ * side panels, where their labels are hidden.
+ *
+ * Since: 3.4
+ */
+void
+xapp_status_icon_host_set_panel_position (XAppStatusIconHost *host,
+                                          GtkPositionType     position)
+{
+    XAppStatusIconHostPrivate *priv;
+    guint i;
+
+    g_return_if_fail (XAPP_IS_STATUS_ICON_HOST (host));
+
+    priv = xapp_status_icon_host_get_instance_private (host);
+
+    if (priv->panel_position == position)
+    {
+        return;
+    }
+
+    priv->panel_position = position;
+
+    gtk_orientable_set_orientation (GTK_ORIENTABLE (host),
+                                    position == GTK_POS_LEFT || position == GTK_POS_RIGHT ?
+                                        GTK_ORIENTATION_VERTICAL : GTK_ORIENTATION_HORIZONTAL);
+
+    for (i = 0; i < priv->items->len; i++)
+    {
+        update_label (g_ptr_array_index (priv->items, i));
+    }
+
+    g_object_notify_by_pspec (G_OBJECT (host), obj_properties[PROP_PANEL_POSITION]);
+}
+
+/**
+ * xapp_status_icon_host_get_panel_position:
+ * @host: an #XAppStatusIconHost
+ *
+ * Gets the screen edge @host's panel is on.
+ *
+ * Returns: the panel position.
+ *
+ * Since: 3.4
+ */
+GtkPositionType
+xapp_status_icon_host_get_panel_position (XAppStatusIconHost *host)
+{
+    XAppStatusIconHostPrivate *priv;
+
+    g_return_val_if_fail (XAPP_IS_STATUS_ICON_HOST (host), GTK_POS_BOTTOM);
+
+    priv = xapp_status_icon_host_get_instance_private (host);
+
+    return priv->panel_position;
+}
@@ -0,0 +1,29 @@
+#ifndef __XAPP_STATUS_ICON_HOST_H__
+#define __XAPP_STATUS_ICON_HOST_H__
+
+#include <stdio.h>
+#include <gtk/gtk.h>
+
+#include <glib-object.h>
+
+#include "xapp-status-icon-monitor.h"
+
+G_BEGIN_DECLS
+
+#define XAPP_TYPE_STATUS_ICON_HOST (xapp_status_icon_host_get_type ())
+G_DECLARE_FINAL_TYPE (XAppStatusIconHost, xapp_status_icon_host, XAPP, STATUS_ICON_HOST, GtkBox)
+
+GtkWidget             *xapp_status_icon_host_new                (XAppStatusIconMonitor *monitor);
+XAppStatusIconMonitor *xapp_status_icon_host_get_monitor        (XAppStatusIconHost    *host);
+
+void                   xapp_status_icon_host_set_icon_size      (XAppStatusIconHost    *host,
+                                                                 gint                   icon_size);
+gint                   xapp_status_icon_host_get_icon_size      (XAppStatusIconHost    *host);
+
+void                   xapp_status_icon_host_set_panel_position (XAppStatusIconHost    *host,
+                                                                 GtkPositionType        position);
+GtkPositionType        xapp_status_icon_host_get_panel_position (XAppStatusIconHost    *host);
+
+G_END_DECLS
+
+#endif  /* __XAPP_STATUS_ICON_HOST_H__ */
@@ -15,9 +15,11 @@
 #include "xapp-status-icon.h"
 #include "xapp-status-icon-monitor.h"
 #include "xapp-statusicon-interface.h"
+#include "xapp-enums.h"
 
 #define DEBUG_FLAG XAPP_DEBUG_STATUS_ICON
 #include "xapp-debug.h"
+#include "xapp-trace.h"
 
 #define MONITOR_NAME "org.x.StatusIconMonitor"
 
@@ -29,15 +31,39 @@
 
 #define WATCHER_MAX_RESTARTS 2
 
+// How long the icons of an app that left the bus wait for it to come back.
+#define VANISHED_ICON_GRACE_MS 3000
+
 enum
 {
     ICON_ADDED,
     ICON_REMOVED,
+    ICON_CHANGED,
+    ICON_REPLACED,
     LAST_SIGNAL
 };
 
 static guint signals[LAST_SIGNAL] = {0, };
 
+static const struct
+{
+    const gchar *property;
+    XAppStatusIconChange change;
+} property_changes[] = {
+    { "Name",                XAPP_STATUS_ICON_CHANGE_NAME },
+    { "IconName",            XAPP_STATUS_ICON_CHANGE_ICON_NAME },
+    { "TooltipText",         XAPP_STATUS_ICON_CHANGE_TOOLTIP_TEXT },
+    { "Label",               XAPP_STATUS_ICON_CHANGE_LABEL },
+    { "Visible",             XAPP_STATUS_ICON_CHANGE_VISIBLE },
+    { "IconSize",            XAPP_STATUS_ICON_CHANGE_ICON_SIZE },
+    { "PrimaryMenuIsOpen",   XAPP_STATUS_ICON_CHANGE_MENU_STATE },
+    { "SecondaryMenuIsOpen", XAPP_STATUS_ICON_CHANGE_MENU_STATE },
+    { "Metadata",            XAPP_STATUS_ICON_CHANGE_METADATA },
+    { "IconFrames",          XAPP_STATUS_ICON_CHANGE_ANIMATION },
+    { "FrameInterval",       XAPP_STATUS_ICON_CHANGE_ANIMATION },
+    { "IconPixelsSerial",    XAPP_STATUS_ICON_CHANGE_ICON_PIXELS }
+};
+
 /**
  * SECTION:xapp-status-icon-monitor
  * @Short_description: Looks for XAppStatusIcons on DBUS and communicates
@@ -55,15 +81,62 @@ static guint signals[LAST_SIGNAL] = {0, };
  *
  * The proxy also provides methods to handle clicks, which can be called by the applet,
  * to request that the app display its menu.
+ *
+ * Since 3.4, the monitor is also a #GListModel of the same proxies, kept sorted by the
+ * app's bus name and then the icon's object path. Applets can use its
+ * #GListModel::items-changed signal to update incrementally, rather than re-listing
+ * and re-sorting the icons on each change.
+ *
+ * Applets that connect to #XAppStatusIconMonitor::icon-replaced also get restarting
+ * apps handed over to their existing icons, rather than removed and added again.
  */
+/* One per status icon app (org.x.StatusIcon.* name) on the bus. */
+typedef struct
+{
+    XAppStatusIconMonitor *monitor;
+
+    gchar *name;
+    gchar *owner;          // unique name, NULL until GetManagedObjects returns.
+    GHashTable *icons;     // object path -> GSequenceIter in the registry
+    GCancellable *cancellable;
+} IconApp;
+
+/* An icon in the registry, which is sorted by app name, then object path. */
+typedef struct
+{
+    gchar *app_name;
+    gchar *object_path;
+    GDBusProxy *proxy;
+    gboolean vanished;     // its app left the bus, see VanishedIcon
+} IconEntry;
+
+/* An icon whose app left the bus. It stays in the registry for a little
+ * while, in case the app is only restarting. */
+typedef struct
+{
+    XAppStatusIconMonitor *monitor;
+
+    gchar *key;               // the icon's Name property and object path
+    GSequenceIter *seq_iter;
+    guint timeout_id;
+} VanishedIcon;
+
 typedef struct
 {
     GDBusConnection *connection;
 
-    GHashTable *object_managers;
+    GHashTable *apps;           // well-known name -> IconApp
+    GHashTable *apps_by_owner;  // unique name -> IconApp (not owned)
+    GSequence *registry;        // IconEntry, the list model's items
+    GHashTable *vanished;       // vanished icon key -> VanishedIcon
 
     guint owner_id;
     guint listener_id;
+    guint interfaces_listener_id;
+    guint properties_listener_id;
+
+    // When we last started looking for icon apps, for tracing.
+    gint64 discovery_begin;
 } XAppStatusIconMonitorPrivate;
 
 struct _XAppStatusIconMonitor
@@ -71,152 +144,665 @@ struct _XAppStatusIconMonitor
     GObject parent_instance;
 };
 
-G_DEFINE_TYPE_WITH_PRIVATE (XAppStatusIconMonitor, xapp_status_icon_monitor, G_TYPE_OBJECT)
+static void xapp_status_icon_monitor_list_model_init (GListModelInterface *iface);
+
+G_DEFINE_TYPE_EXTENDED (XAppStatusIconMonitor,
+                        xapp_status_icon_monitor,
+                        G_TYPE_OBJECT,
+                        0,
+                        G_ADD_PRIVATE (XAppStatusIconMonitor)
+                        G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, xapp_status_icon_monitor_list_model_init))
 
 static void
-on_object_manager_name_owner_changed (GObject    *object,
-                                      GParamSpec *pspec,
-                                      gpointer    user_data)
+icon_entry_free (IconEntry *entry)
 {
-    XAppStatusIconMonitor *self = XAPP_STATUS_ICON_MONITOR (user_data);
-    XAppStatusIconMonitorPrivate *priv = xapp_status_icon_monitor_get_instance_private (self);
-    gchar *name, *owner;
+    g_free (entry->app_name);
+    g_free (entry->object_path);
+    g_object_unref (entry->proxy);
+
+    g_slice_free (IconEntry, entry);
+}
+
+static gint
+compare_icon_entries (gconstpointer a,
+                      gconstpointer b,
+                      gpointer      user_data)
+{
+    const IconEntry *entry_a = a;
+    const IconEntry *entry_b = b;
+    gint ret;
 
-    g_object_get (object,
-                  "name-owner", &owner,
-                  "name", &name,
-                  NULL);
+    ret = g_strcmp0 (entry_a->app_name, entry_b->app_name);
+
+    if (ret == 0)
+    {
+        ret = g_strcmp0 (entry_a->object_path, entry_b->object_path);
+    }
+
+    return ret;
+}
 
-    DEBUG("App name owner changed - name '%s' is now %s)",
-            name, owner != NULL ? "owned" : "unowned");
+static XAppStatusIconChange
+property_to_change (const gchar *property)
+{
+    guint i;
 
-    if (owner == NULL)
+    for (i = 0; i < G_N_ELEMENTS (property_changes); i++)
     {
-        g_hash_table_remove (priv->object_managers, name);
+        if (g_strcmp0 (property, property_changes[i].property) == 0)
+        {
+            return property_changes[i].change;
+        }
     }
 
-    g_free (owner);
-    g_free (name);
+    return XAPP_STATUS_ICON_CHANGE_OTHER;
 }
 
 static void
-object_manager_object_added (XAppObjectManagerClient *manager,
-                             GDBusObject             *object,
-                             gpointer                 user_data)
+remove_from_registry (XAppStatusIconMonitor *self,
+                      GSequenceIter         *seq_iter)
 {
-    XAppStatusIconMonitor *self = XAPP_STATUS_ICON_MONITOR (user_data);
-    GDBusInterface *proxy;
+    IconEntry *entry = g_sequence_get (seq_iter);
+    GDBusProxy *proxy;
+    guint position;
 
-    proxy = g_dbus_object_get_interface (object, STATUS_ICON_INTERFACE);
+    proxy = g_object_ref (entry->proxy);
+    position = g_sequence_iter_get_position (seq_iter);
 
-    g_signal_emit (self, signals[ICON_ADDED], 0, XAPP_STATUS_ICON_INTERFACE_PROXY (proxy));
+    g_sequence_remove (seq_iter);
+
+    g_list_model_items_changed (G_LIST_MODEL (self), position, 1, 0);
+    g_signal_emit (self, signals[ICON_REMOVED], 0, proxy);
 
     g_object_unref (proxy);
 }
 
 static void
-object_manager_object_removed (XAppObjectManagerClient *manager,
-                               GDBusObject             *object,
-                               gpointer                 user_data)
+vanished_icon_free (VanishedIcon *vanished)
 {
-    XAppStatusIconMonitor *self = XAPP_STATUS_ICON_MONITOR (user_data);
-    GDBusInterface *proxy;
+    if (vanished->timeout_id > 0)
+    {
+        g_source_remove (vanished->timeout_id);
+    }
+
+    g_free (vanished->key);
 
-    proxy = g_dbus_object_get_interface (object, STATUS_ICON_INTERFACE);
+    g_slice_free (VanishedIcon, vanished);
+}
 
-    g_signal_emit (self, signals[ICON_REMOVED], 0, XAPP_STATUS_ICON_INTERFACE_PROXY (proxy));
+static gboolean
+on_vanished_icon_timeout (gpointer user_data)
+{
+    VanishedIcon *vanished = user_data;
+    XAppStatusIconMonitor *self = vanished->monitor;
+    XAppStatusIconMonitorPrivate *priv = xapp_status_icon_monitor_get_instance_private (self);
+    GSequenceIter *seq_iter = vanished->seq_iter;
 
-    g_object_unref (proxy);
+    DEBUG ("Status icon '%s' didn't come back, removing it", vanished->key);
+
+    vanished->timeout_id = 0;
+    g_hash_table_remove (priv->vanished, vanished->key);
+
+    remove_from_registry (self, seq_iter);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Name defaults to the program name, so it's shared by every icon of an app,
+ * and by other copies of the same program. The object path tells an app's
+ * icons apart - it's numbered in the order they were made, which a restarted
+ * app repeats. */
+static gchar *
+get_vanished_icon_key (GDBusProxy  *proxy,
+                       const gchar *object_path)
+{
+    const gchar *name;
+
+    name = xapp_status_icon_interface_get_name (XAPP_STATUS_ICON_INTERFACE (proxy));
+
+    if (name == NULL || name[0] == '\0')
+    {
+        return NULL;
+    }
+
+    return g_strdup_printf ("%s %s", name, object_path);
+}
+
+/* Keeps an icon of an app that left the bus in the registry for a while, rather
+ * than removing it. Only icons with a Name can be matched up again later, and
+ * only the first with any one Name and object path. */
+static gboolean
+keep_vanished_icon (XAppStatusIconMonitor *self,
+                    GSequenceIter         *seq_iter)
+{
+    XAppStatusIconMonitorPrivate *priv = xapp_status_icon_monitor_get_instance_private (self);
+    IconEntry *entry = g_sequence_get (seq_iter);
+    VanishedIcon *vanished;
+    gchar *key;
+
+    key = get_vanished_icon_key (entry->proxy, entry->object_path);
+
+    if (key == NULL || g_hash_table_contains (priv->vanished, key))
+    {
+        g_free (key);
+        return FALSE;
+    }
+
+    DEBUG ("Keeping status icon '%s' (%s) in case its app comes back",
+           key, entry->app_name);
+
+    vanished = g_slice_new0 (VanishedIcon);
+    vanished->monitor = self;
+    vanished->key = key;
+    vanished->seq_iter = seq_iter;
+    vanished->timeout_id = g_timeout_add (VANISHED_ICON_GRACE_MS, on_vanished_icon_timeout, vanished);
+
+    g_hash_table_insert (priv->vanished, vanished->key, vanished);
+
+    entry->vanished = TRUE;
+
+    return TRUE;
+}
+
+/* Hands a vanished icon's place in the registry over to the same icon from its
+ * app's new instance. */
+static gboolean
+replace_vanished_icon (IconApp     *app,
+                       const gchar *object_path,
+                       GDBusProxy  *proxy)
+{
+    XAppStatusIconMonitor *self = app->monitor;
+    XAppStatusIconMonitorPrivate *priv = xapp_status_icon_monitor_get_instance_private (self);
+    VanishedIcon *vanished;
+    IconEntry *entry;
+    GSequenceIter *seq_iter;
+    GDBusProxy *old_proxy;
+    gchar *key;
+    guint old_position, new_position, first, n_changed;
+
+    key = get_vanished_icon_key (proxy, object_path);
+
+    if (key == NULL)
+    {
+        return FALSE;
+    }
+
+    vanished = g_hash_table_lookup (priv->vanished, key);
+
+    if (vanished == NULL)
+    {
+        g_free (key);
+        return FALSE;
+    }
+
+    DEBUG ("Status icon '%s' is back: %s", key, app->name);
+
+    seq_iter = vanished->seq_iter;
+    g_hash_table_remove (priv->vanished, key);
+    g_free (key);
+
+    entry = g_sequence_get (seq_iter);
+    old_proxy = entry->proxy;
+    old_position = g_sequence_iter_get_position (seq_iter);
+
+    g_free (entry->app_name);
+    g_free (entry->object_path);
+    entry->app_name = g_strdup (app->name);
+    entry->object_path = g_strdup (object_path);
+    entry->proxy = proxy;
+    entry->vanished = FALSE;
+
+    g_sequence_sort_changed (seq_iter, compare_icon_entries, NULL);
+    new_position = g_sequence_iter_get_position (seq_iter);
+
+    g_hash_table_insert (app->icons, entry->object_path, seq_iter);
+
+    /* The entry has moved already, so describe everything between where it was
+     * and where it is now in one go - two signals would each let a handler see
+     * the model in a state the signal doesn't describe. */
+    first = MIN (old_position, new_position);
+    n_changed = MAX (old_position, new_position) - first + 1;
+
+    g_list_model_items_changed (G_LIST_MODEL (self), first, n_changed, n_changed);
+
+    g_signal_emit (self, signals[ICON_REPLACED], 0, old_proxy, proxy);
+
+    g_object_unref (old_proxy);
+
+    return TRUE;
 }
 
 static void
-new_object_manager_created (GObject      *object,
-                            GAsyncResult *res,
-                            gpointer      user_data)
+icon_app_free (IconApp *app)
 {
-    XAppStatusIconMonitor *self = XAPP_STATUS_ICON_MONITOR (user_data);
+    g_cancellable_cancel (app->cancellable);
+    g_object_unref (app->cancellable);
+
+    g_hash_table_unref (app->icons);
+    g_free (app->name);
+    g_free (app->owner);
+
+    g_slice_free (IconApp, app);
+}
+
+static gboolean
+is_status_icon_name (const gchar *name)
+{
+    /* org.x.StatusIcon.<something>, and nothing deeper */
+    return g_str_has_prefix (name, STATUS_ICON_MATCH) &&
+           name[strlen (STATUS_ICON_MATCH)] != '\0' &&
+           strchr (name + strlen (STATUS_ICON_MATCH), '.') == NULL;
+}
+
+static void
+add_icon (IconApp     *app,
+          const gchar *object_path,
+          GVariant    *properties)
+{
+    XAppStatusIconMonitor *self = app->monitor;
     XAppStatusIconMonitorPrivate *priv = xapp_status_icon_monitor_get_instance_private (self);
-    GDBusObjectManager *obj_mgr;
-    GList *objects = NULL, *iter;
+    GDBusProxy *proxy;
+    IconEntry *entry;
+    GSequenceIter *seq_iter;
+    GVariantIter iter;
+    const gchar *prop_name;
+    GVariant *value;
+    GError *error;
+
+    if (g_hash_table_contains (app->icons, object_path))
+    {
+        return;
+    }
+
+    error = NULL;
+
+    /* Properties and signals both come through the monitor's shared
+     * subscriptions (see on_icon_app_signal), so the proxy needs neither - and
+     * because it's made for the unique name, it doesn't watch the owner either.
+     * This doesn't block. */
+    proxy = g_initable_new (XAPP_TYPE_STATUS_ICON_INTERFACE_PROXY,
+                            NULL,
+                            &error,
+                            "g-connection", priv->connection,
+                            "g-flags", G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                       G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS |
+                                       G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START,
+                            "g-name", app->owner,
+                            "g-object-path", object_path,
+                            "g-interface-name", STATUS_ICON_INTERFACE,
+                            NULL);
+
+    if (proxy == NULL)
+    {
+        g_warning ("Couldn't create proxy for status icon %s%s: %s", app->name, object_path, error->message);
+        g_error_free (error);
+        return;
+    }
+
+    g_variant_iter_init (&iter, properties);
+
+    while (g_variant_iter_next (&iter, "{&sv}", &prop_name, &value))
+    {
+        g_dbus_proxy_set_cached_property (proxy, prop_name, value);
+        g_variant_unref (value);
+    }
+
+    if (replace_vanished_icon (app, object_path, proxy))
+    {
+        return;
+    }
+
+    DEBUG ("Status icon added: %s%s", app->name, object_path);
+
+    entry = g_slice_new0 (IconEntry);
+    entry->app_name = g_strdup (app->name);
+    entry->object_path = g_strdup (object_path);
+    entry->proxy = proxy;
+
+    seq_iter = g_sequence_insert_sorted (priv->registry, entry, compare_icon_entries, NULL);
+    g_hash_table_insert (app->icons, entry->object_path, seq_iter);
+
+    g_list_model_items_changed (G_LIST_MODEL (self), g_sequence_iter_get_position (seq_iter), 0, 1);
+    g_signal_emit (self, signals[ICON_ADDED], 0, proxy);
+}
+
+static void
+remove_icon (IconApp     *app,
+             const gchar *object_path)
+{
+    GSequenceIter *seq_iter;
+
+    seq_iter = g_hash_table_lookup (app->icons, object_path);
+
+    if (seq_iter == NULL)
+    {
+        return;
+    }
+
+    DEBUG ("Status icon removed: %s%s", app->name, object_path);
+
+    g_hash_table_remove (app->icons, object_path);
+
+    remove_from_registry (app->monitor, seq_iter);
+}
+
+/* With keep_icons, the app has left the bus, and if anyone is listening for
+ * icon-replaced, its icons are kept for a while in case it's restarting. */
+static void
+remove_icon_app (XAppStatusIconMonitor *self,
+                 const gchar           *name,
+                 gboolean               keep_icons)
+{
+    XAppStatusIconMonitorPrivate *priv = xapp_status_icon_monitor_get_instance_private (self);
+    IconApp *app;
+    GList *icons, *iter;
+
+    app = g_hash_table_lookup (priv->apps, name);
+
+    if (app == NULL)
+    {
+        return;
+    }
+
+    DEBUG ("Status icon app removed: %s", name);
+
+    if (app->owner != NULL && g_hash_table_lookup (priv->apps_by_owner, app->owner) == app)
+    {
+        g_hash_table_remove (priv->apps_by_owner, app->owner);
+    }
+
+    icons = g_hash_table_get_values (app->icons);
+    g_hash_table_remove_all (app->icons);
+
+    keep_icons = keep_icons && g_signal_has_handler_pending (self, signals[ICON_REPLACED], 0, TRUE);
+
+    for (iter = icons; iter != NULL; iter = iter->next)
+    {
+        if (keep_icons && keep_vanished_icon (self, iter->data))
+        {
+            continue;
+        }
 
+        remove_from_registry (self, iter->data);
+    }
+
+    g_list_free (icons);
+
+    g_hash_table_remove (priv->apps, name);
+}
+
+static void
+on_get_managed_objects_completed (GObject      *source,
+                                  GAsyncResult *res,
+                                  gpointer      user_data)
+{
+    IconApp *app;
+    XAppStatusIconMonitorPrivate *priv;
+    GDBusMessage *reply;
+    GVariant *body;
+    GVariantIter *iter;
+    const gchar *object_path;
+    GVariant *interfaces;
     GError *error;
-    gchar *name;
 
     error = NULL;
 
-    obj_mgr = xapp_object_manager_client_new_finish (res,
-                                                     &error);
+    reply = g_dbus_connection_send_message_with_reply_finish (G_DBUS_CONNECTION (source),
+                                                              res,
+                                                              &error);
+
+    if (reply == NULL)
+    {
+        // Only cancelled when the app is freed, so don't touch it.
+        if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+            g_warning ("XAppStatusIconMonitor: GetManagedObjects failed: %s", error->message);
+        }
+
+        g_error_free (error);
+        return;
+    }
+
+    app = user_data;
+    priv = xapp_status_icon_monitor_get_instance_private (app->monitor);
 
-    if (error)
+    if (g_dbus_message_to_gerror (reply, &error))
     {
-        g_warning ("Couldn't create object manager for bus name: %s", error->message);
+        DEBUG ("GetManagedObjects failed for %s: %s", app->name, error->message);
+
         g_error_free (error);
+        g_object_unref (reply);
+
+        remove_icon_app (app->monitor, app->name, FALSE);
         return;
     }
 
-    g_object_get (obj_mgr, "name", &name, NULL);
+    body = g_dbus_message_get_body (reply);
 
-    DEBUG("Object manager added for new bus name: '%s'", name);
+    if (body == NULL || !g_variant_is_of_type (body, G_VARIANT_TYPE ("(a{oa{sa{sv}}})")))
+    {
+        DEBUG ("GetManagedObjects reply from %s has the wrong type", app->name);
+
+        g_object_unref (reply);
+
+        remove_icon_app (app->monitor, app->name, FALSE);
+        return;
+    }
+
+    /* Names found with ListNames were asked by their well-known name - the
+     * reply tells us who actually answered. Signals are matched by this. */
+    if (app->owner == NULL)
+    {
+        app->owner = g_strdup (g_dbus_message_get_sender (reply));
+    }
+
+    g_hash_table_insert (priv->apps_by_owner, app->owner, app);
+
+    g_variant_get (body, "(a{oa{sa{sv}}})", &iter);
 
-    g_signal_connect (obj_mgr,
-                      "notify::name-owner",
-                      G_CALLBACK (on_object_manager_name_owner_changed),
-                      self);
+    while (g_variant_iter_next (iter, "{&o@a{sa{sv}}}", &object_path, &interfaces))
+    {
+        GVariant *properties;
+
+        properties = g_variant_lookup_value (interfaces, STATUS_ICON_INTERFACE, G_VARIANT_TYPE ("a{sv}"));
+
+        if (properties != NULL)
+        {
+            add_icon (app, object_path, properties);
+            g_variant_unref (properties);
+        }
 
-    g_signal_connect (obj_mgr,
-                      "object-added",
-                      G_CALLBACK (object_manager_object_added),
-                      self);
+        g_variant_unref (interfaces);
+    }
 
-    g_signal_connect (obj_mgr,
-                      "object-removed",
-                      G_CALLBACK (object_manager_object_removed),
-                      self);
+    g_variant_iter_free (iter);
 
-    g_hash_table_insert (priv->object_managers,
-                         name,
-                         obj_mgr);
+    XAPP_TRACE_MARK (priv->discovery_begin, "StatusIconMonitor: icons added",
+                     "%s, icons: %u", app->name, g_hash_table_size (app->icons));
 
-    objects = g_dbus_object_manager_get_objects (obj_mgr);
+    g_object_unref (reply);
+}
+
+static void
+add_icon_app (XAppStatusIconMonitor *self,
+              const gchar           *name,
+              const gchar           *owner)
+{
+    XAppStatusIconMonitorPrivate *priv = xapp_status_icon_monitor_get_instance_private (self);
+    IconApp *app;
+    GDBusMessage *message;
 
-    for (iter = objects; iter != NULL; iter = iter->next)
+    if (!is_status_icon_name (name))
     {
-        GDBusObject *object = G_DBUS_OBJECT (iter->data);
-        GDBusInterface *proxy = g_dbus_object_get_interface (object, STATUS_ICON_INTERFACE);
+        DEBUG ("Adding status icon app failed, bus name '%s' is invalid", name);
+        return;
+    }
+
+    app = g_hash_table_lookup (priv->apps, name);
 
-        g_signal_emit (self, signals[ICON_ADDED], 0, proxy);
+    if (app != NULL)
+    {
+        // Already known, or being asked about.
+        if (app->owner == NULL || g_strcmp0 (app->owner, owner) == 0)
+        {
+            return;
+        }
 
-        g_object_unref (proxy);
+        remove_icon_app (self, name, FALSE);
     }
 
-    g_list_free_full (objects, g_object_unref);
+    DEBUG ("Adding status icon app: %s", name);
+
+    app = g_slice_new0 (IconApp);
+    app->monitor = self;
+    app->name = g_strdup (name);
+    app->owner = g_strdup (owner);
+    app->icons = g_hash_table_new (g_str_hash, g_str_equal);
+    app->cancellable = g_cancellable_new ();
+
+    g_hash_table_insert (priv->apps, app->name, app);
+
+    /* Every app's GetManagedObjects goes out right away - none of them wait on
+     * another's reply. */
+    message = g_dbus_message_new_method_call (owner != NULL ? owner : name,
+                                              STATUS_ICON_PATH,
+                                              "org.freedesktop.DBus.ObjectManager",
+                                              "GetManagedObjects");
+    g_dbus_message_set_flags (message, G_DBUS_MESSAGE_FLAGS_NO_AUTO_START);
+
+    g_dbus_connection_send_message_with_reply (priv->connection,
+                                               message,
+                                               G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+                                               3000, /* 3 secs */
+                                               NULL,
+                                               app->cancellable,
+                                               on_get_managed_objects_completed,
+                                               app);
+
+    g_object_unref (message);
 }
 
+/* Handles the InterfacesAdded, InterfacesRemoved and PropertiesChanged
+ * signals of every status icon app, routing them by sender. */
 static void
-add_object_manager_for_name (XAppStatusIconMonitor *self,
-                             const gchar           *name)
+on_icon_app_signal (GDBusConnection *connection,
+                    const gchar     *sender_name,
+                    const gchar     *object_path,
+                    const gchar     *interface_name,
+                    const gchar     *signal_name,
+                    GVariant        *parameters,
+                    gpointer         user_data)
 {
+    XAppStatusIconMonitor *self = XAPP_STATUS_ICON_MONITOR (user_data);
     XAppStatusIconMonitorPrivate *priv = xapp_status_icon_monitor_get_instance_private (self);
-    gchar **name_parts = NULL;
+    IconApp *app;
 
-    name_parts = g_strsplit (name, ".", -1);
+    app = g_hash_table_lookup (priv->apps_by_owner, sender_name);
 
-    if (g_strv_length (name_parts) == 4)
+    /* Not a status icon app, or one we're still waiting on - anything sent
+     * before its GetManagedObjects reply is already part of that reply. */
+    if (app == NULL)
     {
-        xapp_object_manager_client_new (priv->connection,
-                                        G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_DO_NOT_AUTO_START,
-                                        name,
-                                        STATUS_ICON_PATH,
-                                        NULL,
-                                        new_object_manager_created,
-                                        self);
+        return;
+    }
+
+    if (g_strcmp0 (signal_name, "PropertiesChanged") == 0)
+    {
+        GSequenceIter *seq_iter;
+        GDBusProxy *proxy;
+        GVariant *changed;
+        const gchar **invalidated;
+        GVariantIter iter;
+        const gchar *prop_name;
+        GVariant *value;
+        XAppStatusIconChange changes = XAPP_STATUS_ICON_CHANGE_NONE;
+        guint i;
+
+        if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sa{sv}as)")))
+        {
+            return;
+        }
+
+        seq_iter = g_hash_table_lookup (app->icons, object_path);
+
+        if (seq_iter == NULL)
+        {
+            return;
+        }
+
+        proxy = ((IconEntry *) g_sequence_get (seq_iter))->proxy;
+
+        g_variant_get (parameters, "(&s@a{sv}^a&s)", NULL, &changed, &invalidated);
+
+        g_variant_iter_init (&iter, changed);
+
+        while (g_variant_iter_next (&iter, "{&sv}", &prop_name, &value))
+        {
+            g_dbus_proxy_set_cached_property (proxy, prop_name, value);
+            changes |= property_to_change (prop_name);
+            g_variant_unref (value);
+        }
+
+        for (i = 0; invalidated[i] != NULL; i++)
+        {
+            g_dbus_proxy_set_cached_property (proxy, invalidated[i], NULL);
+            changes |= property_to_change (invalidated[i]);
+        }
+
+        // The generated proxy turns this into notify:: signals.
+        g_signal_emit_by_name (proxy, "g-properties-changed", changed, invalidated);
+
+        if (changes != XAPP_STATUS_ICON_CHANGE_NONE)
+        {
+            g_signal_emit (self, signals[ICON_CHANGED], 0, proxy, changes);
+        }
+
+        g_variant_unref (changed);
+        g_free (invalidated);
     }
     else
+    if (g_strcmp0 (signal_name, "InterfacesAdded") == 0)
     {
-        DEBUG ("Adding object manager failed, bus name '%s' is invalid", name);
+        const gchar *path;
+        GVariant *interfaces, *properties;
+
+        if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(oa{sa{sv}})")))
+        {
+            return;
+        }
+
+        g_variant_get (parameters, "(&o@a{sa{sv}})", &path, &interfaces);
+
+        properties = g_variant_lookup_value (interfaces, STATUS_ICON_INTERFACE, G_VARIANT_TYPE ("a{sv}"));
+
+        if (properties != NULL)
+        {
+            add_icon (app, path, properties);
+            g_variant_unref (properties);
+        }
+
+        g_variant_unref (interfaces);
     }
+    else
+    if (g_strcmp0 (signal_name, "InterfacesRemoved") == 0)
+    {
+        const gchar *path;
+        const gchar **interfaces;
 
-    g_strfreev (name_parts);
+        if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(oas)")))
+        {
+            return;
+        }
+
+        g_variant_get (parameters, "(&o^a&s)", &path, &interfaces);
+
+        if (g_strv_contains (interfaces, STATUS_ICON_INTERFACE))
+        {
+            remove_icon (app, path);
+        }
+
+        g_free (interfaces);
+    }
 }
 
 static void
@@ -225,6 +811,7 @@ on_list_names_completed (GObject      *source,
                          gpointer      user_data)
 {
     XAppStatusIconMonitor *self = XAPP_STATUS_ICON_MONITOR (user_data);
+    XAppStatusIconMonitorPrivate *priv = xapp_status_icon_monitor_get_instance_private (self);
     GVariant *result;
     GVariantIter *iter;
     gchar *str;
@@ -243,6 +830,8 @@ on_list_names_completed (GObject      *source,
       return;
     }
 
+    XAPP_TRACE_MARK (priv->discovery_begin, "StatusIconMonitor: ListNames", "completed");
+
     g_variant_get (result, "(as)", &iter);
 
     while (g_variant_iter_loop (iter, "s", &str))
@@ -251,7 +840,7 @@ on_list_names_completed (GObject      *source,
         if (g_str_has_prefix (str, STATUS_ICON_MATCH))
         {
             DEBUG ("Found new status icon app: %s", str);
-            add_object_manager_for_name (self, str);
+            add_icon_app (self, str, NULL);
         }
     }
 
@@ -266,6 +855,8 @@ find_and_add_icons (XAppStatusIconMonitor *self)
 
     DEBUG("Looking for status icon apps on the bus");
 
+    priv->discovery_begin = XAPP_TRACE_CURRENT_TIME;
+
     /* If there are no monitors (applets) already running when this is set up,
      * this won't find anything.  The XAppStatusIcons will be in fallback mode,
      * and will only attempt to switch back after seeing this monitor appear
@@ -312,6 +903,7 @@ name_owner_changed (GDBusConnection *connection,
                     gpointer         user_data)
 {
     XAppStatusIconMonitor *self = XAPP_STATUS_ICON_MONITOR (user_data);
+    XAppStatusIconMonitorPrivate *priv = xapp_status_icon_monitor_get_instance_private (self);
 
     const gchar *name;
     const gchar *old_owner;
@@ -321,9 +913,15 @@ name_owner_changed (GDBusConnection *connection,
 
     g_variant_get (parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
 
+    if (old_owner[0] != '\0')
+    {
+        remove_icon_app (self, name, TRUE);
+    }
+
     if (new_owner[0] != '\0')
     {
-        add_object_manager_for_name (self, name);
+        priv->discovery_begin = XAPP_TRACE_CURRENT_TIME;
+        add_icon_app (self, name, new_owner);
     }
 }
 
@@ -344,6 +942,30 @@ add_name_listener (XAppStatusIconMonitor *self)
                                                             name_owner_changed,
                                                             self,
                                                             NULL);
+
+    /* Every app's icons come and go, and change, through these two - rather
+     * than a set of subscriptions per app. */
+    priv->interfaces_listener_id = g_dbus_connection_signal_subscribe (priv->connection,
+                                                                       NULL,
+                                                                       "org.freedesktop.DBus.ObjectManager",
+                                                                       NULL,
+                                                                       STATUS_ICON_PATH,
+                                                                       NULL,
+                                                                       G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                       on_icon_app_signal,
+                                                                       self,
+                                                                       NULL);
+
+    priv->properties_listener_id = g_dbus_connection_signal_subscribe (priv->connection,
+                                                                       NULL,
+                                                                       "org.freedesktop.DBus.Properties",
+                                                                       "PropertiesChanged",
+                                                                       NULL,
+                                                                       STATUS_ICON_INTERFACE,
+                                                                       G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                       on_icon_app_signal,
+                                                                       self,
+                                                                       NULL);
 }
 
 static void
@@ -414,8 +1036,12 @@ xapp_status_icon_monitor_init (XAppStatusIconMonitor *self)
 {
     XAppStatusIconMonitorPrivate *priv = xapp_status_icon_monitor_get_instance_private (self);
 
-    priv->object_managers = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                   g_free, g_object_unref);
+    priv->apps = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                        NULL, (GDestroyNotify) icon_app_free);
+    priv->apps_by_owner = g_hash_table_new (g_str_hash, g_str_equal);
+    priv->registry = g_sequence_new ((GDestroyNotify) icon_entry_free);
+    priv->vanished = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            NULL, (GDestroyNotify) vanished_icon_free);
 
     connect_to_bus (self);
 }
@@ -436,10 +1062,28 @@ xapp_status_icon_monitor_dispose (GObject *object)
             priv->listener_id = 0;
         }
 
-        if (priv->object_managers != NULL)
+        if (priv->interfaces_listener_id > 0)
+        {
+            g_dbus_connection_signal_unsubscribe (priv->connection, priv->interfaces_listener_id);
+            priv->interfaces_listener_id = 0;
+        }
+
+        if (priv->properties_listener_id > 0)
+        {
+            g_dbus_connection_signal_unsubscribe (priv->connection, priv->properties_listener_id);
+            priv->properties_listener_id = 0;
+        }
+
+        if (priv->apps_by_owner != NULL)
+        {
+            g_hash_table_unref (priv->apps_by_owner);
+            priv->apps_by_owner = NULL;
+        }
+
+        if (priv->apps != NULL)
         {
-            g_hash_table_unref (priv->object_managers);
-            priv->object_managers = NULL;
+            g_hash_table_unref (priv->apps);
+            priv->apps = NULL;
         }
 
         if (priv->owner_id > 0)
@@ -451,6 +1095,9 @@ xapp_status_icon_monitor_dispose (GObject *object)
         g_clear_object (&priv->connection);
     }
 
+    g_clear_pointer (&priv->vanished, g_hash_table_unref);
+    g_clear_pointer (&priv->registry, g_sequence_free);
+
     G_OBJECT_CLASS (xapp_status_icon_monitor_parent_class)->dispose (object);
 }
 
@@ -501,38 +1148,117 @@ xapp_status_icon_monitor_class_init (XAppStatusIconMonitorClass *klass)
                       0,
                       NULL, NULL, NULL,
                       G_TYPE_NONE, 1, XAPP_TYPE_STATUS_ICON_INTERFACE_PROXY);
+
+  /**
+   * XAppStatusIconMonitor::icon-changed:
+   * @monitor: the #XAppStatusIconMonitor
+   * @proxy: the #XAppStatusIcon proxy that changed.
+   * @changes: the #XAppStatusIconChange flags for what changed.
+   *
+   * This signal is emitted once for each batch of property changes an
+   * #XAppStatusIcon sends, after the proxy's properties are updated (and
+   * its notify signals emitted). Applets can use it to make a single update
+   * for several properties changing together, instead of one per property.
+   *
+   * Since: 3.4
+   */
+    signals[ICON_CHANGED] =
+        g_signal_new ("icon-changed",
+                      XAPP_TYPE_STATUS_ICON_MONITOR,
+                      G_SIGNAL_RUN_LAST,
+                      0,
+                      NULL, NULL, NULL,
+                      G_TYPE_NONE, 2, XAPP_TYPE_STATUS_ICON_INTERFACE_PROXY, XAPP_TYPE_STATUS_ICON_CHANGE);
+
+  /**
+   * XAppStatusIconMonitor::icon-replaced:
+   * @monitor: the #XAppStatusIconMonitor
+   * @old_proxy: the proxy for the icon that went away.
+   * @new_proxy: the proxy for the same icon, from the app's new instance.
+   *
+   * When an app leaves the bus, its icons are kept for a few seconds, in case
+   * it's only restarting. If it comes back in that time with an icon of the same
+   * name and object path (icons are numbered in the order the app makes them),
+   * this is emitted instead of #XAppStatusIconMonitor::icon-removed and
+   * #XAppStatusIconMonitor::icon-added, so an applet can point the icon's existing
+   * widget at @new_proxy.
+   *
+   * While they wait, these icons stay in the monitor's #GListModel items, but
+   * their proxies are for an app that's no longer there: calls to them fail, and
+   * they won't change. They're left out of xapp_status_icon_monitor_list_icons().
+   * If the app doesn't come back, #XAppStatusIconMonitor::icon-removed is emitted
+   * for them then.
+   *
+   * Icons are only kept like this when something is connected to this signal.
+   * Otherwise they're removed as soon as their app leaves, as before.
+   *
+   * Since: 3.4
+   */
+    signals[ICON_REPLACED] =
+        g_signal_new ("icon-replaced",
+                      XAPP_TYPE_STATUS_ICON_MONITOR,
+                      G_SIGNAL_RUN_LAST,
+                      0,
+                      NULL, NULL, NULL,
+                      G_TYPE_NONE, 2, XAPP_TYPE_STATUS_ICON_INTERFACE_PROXY, XAPP_TYPE_STATUS_ICON_INTERFACE_PROXY);
 }
 
-static void
-gather_objects_foreach_func (gpointer key,
-                             gpointer value,
-                             gpointer user_data)
+static GType
+xapp_status_icon_monitor_get_item_type (GListModel *list)
 {
-    GDBusObjectManager *obj_mgr = G_DBUS_OBJECT_MANAGER (value);
-    GList **ret = (GList **) user_data;
+    return XAPP_TYPE_STATUS_ICON_INTERFACE_PROXY;
+}
 
-    GList *objects = NULL, *iter;
+static guint
+xapp_status_icon_monitor_get_n_items (GListModel *list)
+{
+    XAppStatusIconMonitorPrivate *priv = xapp_status_icon_monitor_get_instance_private (XAPP_STATUS_ICON_MONITOR (list));
 
-    objects = g_dbus_object_manager_get_objects (obj_mgr);
+    if (priv->registry == NULL)
+    {
+        return 0;
+    }
+
+    return g_sequence_get_length (priv->registry);
+}
+
+static gpointer
+xapp_status_icon_monitor_get_item (GListModel *list,
+                                   guint       position)
+{
+    XAppStatusIconMonitorPrivate *priv = xapp_status_icon_monitor_get_instance_private (XAPP_STATUS_ICON_MONITOR (list));
+    GSequenceIter *seq_iter;
 
-    for (iter = objects; iter != NULL; iter = iter->next)
+    if (priv->registry == NULL)
     {
-        GDBusObject *object = G_DBUS_OBJECT (iter->data);
-        GDBusInterface *proxy = g_dbus_object_get_interface (object, STATUS_ICON_INTERFACE);
+        return NULL;
+    }
 
-        *ret = g_list_prepend (*ret, proxy);
+    seq_iter = g_sequence_get_iter_at_pos (priv->registry, position);
 
-        g_object_unref (proxy);
+    if (g_sequence_iter_is_end (seq_iter))
+    {
+        return NULL;
     }
 
-    g_list_free_full (objects, g_object_unref);
+    return g_object_ref (((IconEntry *) g_sequence_get (seq_iter))->proxy);
+}
+
+static void
+xapp_status_icon_monitor_list_model_init (GListModelInterface *iface)
+{
+    iface->get_item_type = xapp_status_icon_monitor_get_item_type;
+    iface->get_n_items = xapp_status_icon_monitor_get_n_items;
+    iface->get_item = xapp_status_icon_monitor_get_item;
 }
 
 /**
  * xapp_status_icon_monitor_list_icons:
  * @monitor: a #XAppStatusIconMonitor
  *
- * List known icon proxies.
+ * List known icon proxies, in the same order as the monitor's #GListModel items.
+ * Icons whose app left the bus, and that are waiting for it to come back (see
+ * #XAppStatusIconMonitor::icon-replaced), aren't included.
  *
  * Returns: (element-type XAppStatusIconMonitor) (transfer container): a #GList of icons
  *
@@ -546,11 +1272,26 @@ xapp_status_icon_monitor_list_icons (XAppStatusIconMonitor *monitor)
 
     XAppStatusIconMonitorPrivate *priv = xapp_status_icon_monitor_get_instance_private (monitor);
 
-    g_hash_table_foreach (priv->object_managers,
-                          (GHFunc) gather_objects_foreach_func,
-                          &ret);
+    if (priv->registry != NULL)
+    {
+        GSequenceIter *seq_iter;
 
-    return ret;
+        for (seq_iter = g_sequence_get_begin_iter (priv->registry);
+             !g_sequence_iter_is_end (seq_iter);
+             seq_iter = g_sequence_iter_next (seq_iter))
+        {
+            IconEntry *entry = g_sequence_get (seq_iter);
+
+            if (entry->vanished)
+            {
+                continue;
+            }
+
+            ret = g_list_prepend (ret, entry->proxy);
+        }
+    }
+
+    return g_list_reverse (ret);
 }
 
 /**
@@ -12,6 +12,41 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (XAppStatusIconMonitor, xapp_status_icon_monitor, XAPP, STATUS_ICON_MONITOR, GObject)
 
+/**
+ * XAppStatusIconChange:
+ * @XAPP_STATUS_ICON_CHANGE_NONE: Nothing changed.
+ * @XAPP_STATUS_ICON_CHANGE_NAME: The icon's name changed.
+ * @XAPP_STATUS_ICON_CHANGE_ICON_NAME: The icon name (or file) changed.
+ * @XAPP_STATUS_ICON_CHANGE_TOOLTIP_TEXT: The tooltip changed.
+ * @XAPP_STATUS_ICON_CHANGE_LABEL: The label changed.
+ * @XAPP_STATUS_ICON_CHANGE_VISIBLE: The visibility changed.
+ * @XAPP_STATUS_ICON_CHANGE_ICON_SIZE: The icon size changed.
+ * @XAPP_STATUS_ICON_CHANGE_MENU_STATE: The primary or secondary menu was opened or closed.
+ * @XAPP_STATUS_ICON_CHANGE_METADATA: The metadata changed.
+ * @XAPP_STATUS_ICON_CHANGE_ANIMATION: The animation frames or interval changed.
+ * @XAPP_STATUS_ICON_CHANGE_ICON_PIXELS: The icon pixels changed.
+ * @XAPP_STATUS_ICON_CHANGE_OTHER: Some other property changed.
+ *
+ * Which properties of an icon changed, in #XAppStatusIconMonitor::icon-changed.
+ *
+ * Since: 3.4
+ */
+typedef enum
+{
+    XAPP_STATUS_ICON_CHANGE_NONE = 0,
+    XAPP_STATUS_ICON_CHANGE_NAME = 1 << 0,
+    XAPP_STATUS_ICON_CHANGE_ICON_NAME = 1 << 1,
+    XAPP_STATUS_ICON_CHANGE_TOOLTIP_TEXT = 1 << 2,
+    XAPP_STATUS_ICON_CHANGE_LABEL = 1 << 3,
+    XAPP_STATUS_ICON_CHANGE_VISIBLE = 1 << 4,
+    XAPP_STATUS_ICON_CHANGE_ICON_SIZE = 1 << 5,
+    XAPP_STATUS_ICON_CHANGE_MENU_STATE = 1 << 6,
+    XAPP_STATUS_ICON_CHANGE_METADATA = 1 << 7,
+    XAPP_STATUS_ICON_CHANGE_ANIMATION = 1 << 8,
+    XAPP_STATUS_ICON_CHANGE_ICON_PIXELS = 1 << 9,
+    XAPP_STATUS_ICON_CHANGE_OTHER = 1 << 10
+} XAppStatusIconChange;
+
 XAppStatusIconMonitor *xapp_status_icon_monitor_new        (void);
 GList                 *xapp_status_icon_monitor_list_icons (XAppStatusIconMonitor *monitor);
 
@@ -8,7 +8,14 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#ifdef HAVE_MEMFD_CREATE
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
 #include <gtk/gtk.h>
+#include <gio/gunixfdlist.h>
 
 #ifdef HAVE_GTK_LAYER_SHELL
 #include <gdk/gdkwayland.h>
@@ -23,6 +30,7 @@
 
 #define DEBUG_FLAG XAPP_DEBUG_STATUS_ICON
 #include "xapp-debug.h"
+#include "xapp-trace.h"
 
 #define FDO_DBUS_NAME "org.freedesktop.DBus"
 #define FDO_DBUS_PATH "/org/freedesktop/DBus"
@@ -38,6 +46,53 @@
 #define MAX_SANE_ICON_SIZE 96
 #define FALLBACK_ICON_SIZE 24
 
+// Properties changed while an update is in progress (see
+// xapp_status_icon_begin_update()) are recorded here and pushed
+// to the skeleton (and fallback icon) together at the end.
+typedef enum
+{
+    DIRTY_NONE          = 0,
+    DIRTY_NAME          = 1 << 0,
+    DIRTY_ICON_NAME     = 1 << 1,
+    DIRTY_TOOLTIP_TEXT  = 1 << 2,
+    DIRTY_LABEL         = 1 << 3,
+    DIRTY_VISIBLE       = 1 << 4,
+    DIRTY_METADATA      = 1 << 5,
+    DIRTY_ANIMATION     = 1 << 6,
+    DIRTY_PIXELS        = 1 << 7,
+    DIRTY_FALLBACK      = 1 << 8
+} DirtyFlags;
+
+// Properties subject to the optional update rate limit.
+#define THROTTLED_FLAGS (DIRTY_LABEL | DIRTY_TOOLTIP_TEXT)
+
+// What update_fallback_icon() needs to re-apply to the GtkStatusIcon.
+typedef enum
+{
+    FALLBACK_TOOLTIP    = 1 << 0,
+    FALLBACK_VISIBLE    = 1 << 1,
+    FALLBACK_IMAGE      = 1 << 2,
+    FALLBACK_ALL        = FALLBACK_TOOLTIP | FALLBACK_VISIBLE | FALLBACK_IMAGE
+} FallbackFlags;
+
+// Decoded icon files for fallback icons, shared by all icons in the process,
+// most recently used first. Icons alternating between a few files (or several
+// icons using the same one) don't need to decode them again each time.
+#define FALLBACK_PIXBUF_CACHE_SIZE 8
+
+typedef struct
+{
+    gchar *path;
+    guint64 mtime;
+    guint32 mtime_usec;
+    goffset size;
+    GdkPixbuf *pixbuf;
+} CachedPixbuf;
+
+static GQueue fallback_pixbuf_cache = G_QUEUE_INIT;
+
+static const gchar * const no_frames[] = { NULL };
+
 // This gets reffed and unreffed according to individual icon presence.
 // For the first icon, it gets created when exporting the icon's interface.
 // For each additional icon, it gets reffed again. On destruction, the
@@ -47,6 +102,43 @@ static GDBusObjectManagerServer *obj_server = NULL;
 static guint name_owner_id = 0;
 XAppStatusIconState process_icon_state = XAPP_STATUS_ICON_STATE_NO_SUPPORT;
 
+// Looks for status applets (XAppStatusIconMonitors) on behalf of every icon
+// in the process, so there's only ever one ListNames call and one NameOwnerChanged
+// subscription, no matter how many icons there are. It's created for the first
+// icon that connects to the bus, and freed when the last one is disposed - unless
+// xapp_status_icon_any_monitors_async() has been used, then it's kept around for
+// answering that.
+typedef struct
+{
+    GDBusConnection *connection;
+    GCancellable *cancellable;
+    guint listener_id;
+
+    GHashTable *monitors;
+    gboolean have_monitor_list;
+    gboolean have_monitors;
+    gboolean listing;
+
+    GList *icons;
+    GList *tasks;
+    gboolean keep_alive;
+} AppletWatcher;
+
+static AppletWatcher *applet_watcher = NULL;
+
+// Added with xapp_status_icon_watch_monitors(), these are told about the same
+// changes as each icon's monitors-changed signal, for code without an icon.
+typedef struct
+{
+    guint id;
+    XAppStatusIconMonitorsCallback callback;
+    gpointer user_data;
+    GDestroyNotify notify;
+} MonitorsWatch;
+
+static GList *monitors_watches = NULL;
+static guint next_monitors_watch_id = 1;
+
 enum
 {
     BUTTON_PRESS,
@@ -54,6 +146,7 @@ enum
     ACTIVATE,
     STATE_CHANGED,
     SCROLL,
+    MONITORS_CHANGED,
     LAST_SIGNAL
 };
 
@@ -66,6 +159,7 @@ enum
     PROP_SECONDARY_MENU,
     PROP_ICON_SIZE,
     PROP_NAME,
+    PROP_SCROLL_COALESCING,
     N_PROPERTIES
 };
 
@@ -101,10 +195,46 @@ typedef struct
     gint icon_size;
     gchar *metadata;
 
-    guint listener_id;
+    gchar **icon_frames;
+    guint n_frames;
+    guint frame_interval;
+    guint frame_index;
+    guint frame_timer_id;
+    GHashTable *frame_pixbufs;
+
+    GdkPixbuf *icon_pixbuf;
+    gint pixels_fd;
+    gint pixels_width;
+    gint pixels_height;
+    gint pixels_stride;
+    guint pixels_serial;
+
+    gboolean awaiting_applet_state;
 
     gint fail_counter;
     gboolean have_button_press;
+
+    // When the last button press arrived, and its event time, so the
+    // rest of the click-to-menu path can be traced back to it.
+    gint64 click_trace_begin;
+    guint click_trace_time;
+
+    // With scroll_coalescing, scrolls that arrive together are summed and
+    // emitted once.
+    gboolean scroll_coalescing;
+    gint scroll_delta;
+    XAppScrollDirection scroll_direction;
+    guint scroll_time;
+    guint scroll_idle_id;
+
+    guint update_depth;
+    DirtyFlags dirty;
+    FallbackFlags fallback_dirty;
+
+    guint rate_limit;
+    gint64 last_throttled_update;
+    guint throttle_id;
+    DirtyFlags throttled;
 } XAppStatusIconPrivate;
 
 struct _XAppStatusIcon
@@ -271,6 +401,18 @@ synthesize_event (XAppStatusIcon *self,
   return event;
 }
 
+static void
+menu_mapped_trace (GtkWidget *widget,
+                   gpointer   user_data)
+{
+    XAppStatusIcon *icon = XAPP_STATUS_ICON (user_data);
+
+    XAPP_TRACE_MARK (icon->priv->click_trace_begin, "StatusIcon: click to menu shown",
+                     "%s, time: %u", icon->priv->name, icon->priv->click_trace_time);
+
+    g_signal_handlers_disconnect_by_func (widget, menu_mapped_trace, icon);
+}
+
 static void
 primary_menu_unmapped (GtkWidget  *widget,
                        gpointer    user_data)
@@ -317,15 +459,20 @@ should_use_layer_shell (void)
     return gtk_layer_is_supported ();
 }
 
+/* One popup host per monitor, shared by every icon in the process. They're
+ * created on first use and kept mapped (but fully transparent, and taking no
+ * input) until their monitor goes away, so a popup only has to move one, rather
+ * than wait for a new layer surface to be created and configured each time. */
+static GHashTable *layer_hosts = NULL;
+
 static void
-layer_host_menu_unmapped (GtkWidget *toplevel,
-                          gpointer   user_data)
+on_layer_host_monitor_removed (GdkDisplay *display,
+                               GdkMonitor *monitor,
+                               gpointer    user_data)
 {
-    /* user_data is the GtkMenu. Clearing the slot fires the destroy notifier
-     * (gtk_widget_destroy) set when the host was attached, which tears down
-     * the layer surface so it stops intercepting input over the icon. */
-    g_signal_handlers_disconnect_by_func (toplevel, layer_host_menu_unmapped, user_data);
-    g_object_set_data_full (G_OBJECT (user_data), "xapp-layer-host", NULL, NULL);
+    DEBUG ("Monitor removed, destroying its popup host");
+
+    g_hash_table_remove (layer_hosts, monitor);
 }
 
 static gboolean
@@ -341,27 +488,97 @@ layer_host_draw (GtkWidget *widget,
     return FALSE;
 }
 
+static GtkWidget *
+get_wayland_layer_host (GdkDisplay *display,
+                        GdkMonitor *monitor)
+{
+    GtkWidget *host;
+    GdkVisual *visual;
+    cairo_region_t *region;
+
+    if (layer_hosts == NULL)
+    {
+        layer_hosts = g_hash_table_new_full (NULL, NULL,
+                                             NULL, (GDestroyNotify) gtk_widget_destroy);
+
+        g_signal_connect (display,
+                          "monitor-removed",
+                          G_CALLBACK (on_layer_host_monitor_removed),
+                          NULL);
+    }
+
+    host = g_hash_table_lookup (layer_hosts, monitor);
+
+    if (host != NULL)
+    {
+        return host;
+    }
+
+    DEBUG ("Creating popup host for monitor %p", monitor);
+
+    gint64 trace_begin = XAPP_TRACE_CURRENT_TIME;
+
+    host = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+    gtk_widget_set_app_paintable (host, TRUE);
+    g_signal_connect (host, "draw", G_CALLBACK (layer_host_draw), NULL);
+
+    visual = gdk_screen_get_rgba_visual (gtk_widget_get_screen (host));
+    if (visual != NULL)
+    {
+        gtk_widget_set_visual (host, visual);
+    }
+
+    gtk_layer_init_for_window (GTK_WINDOW (host));
+    gtk_layer_set_namespace (GTK_WINDOW (host), "xapp-status-icon-popup");
+    gtk_layer_set_layer (GTK_WINDOW (host), GTK_LAYER_SHELL_LAYER_TOP);
+    /* The icon-owner's screen position is inside the panel/strut area, so we
+     * need to opt out of being moved into the workarea. -1 means "don't shift
+     * me to avoid struts" — the margin we set IS the final position. */
+    gtk_layer_set_exclusive_zone (GTK_WINDOW (host), -1);
+    gtk_layer_set_anchor (GTK_WINDOW (host), GTK_LAYER_SHELL_EDGE_TOP, TRUE);
+    gtk_layer_set_anchor (GTK_WINDOW (host), GTK_LAYER_SHELL_EDGE_LEFT, TRUE);
+    gtk_layer_set_keyboard_mode (GTK_WINDOW (host),
+                                 GTK_LAYER_SHELL_KEYBOARD_MODE_ON_DEMAND);
+    if (monitor != NULL)
+    {
+        gtk_layer_set_monitor (GTK_WINDOW (host), monitor);
+    }
+
+    gtk_widget_realize (host);
+
+    /* The host stays mapped between popups - an empty input region keeps it
+     * from taking clicks meant for the icon (or anything else) beneath it. */
+    region = cairo_region_create ();
+    gdk_window_input_shape_combine_region (gtk_widget_get_window (host), region, 0, 0);
+    cairo_region_destroy (region);
+
+    g_hash_table_insert (layer_hosts, monitor, host);
+
+    XAPP_TRACE_MARK (trace_begin, "StatusIcon: create layer host", "monitor: %p", monitor);
+
+    return host;
+}
+
 /* Wayland clients can't position popups at arbitrary screen coordinates — popups
  * must be anchored to one of the client's own surfaces. The icon-owner has no
- * toplevel at the panel location, so we create an invisible layer-shell surface
+ * toplevel at the panel location, so we use an invisible layer-shell surface
  * placed exactly where the icon is and parent the menu's xdg_popup to that.
  * Muffin's 605bb83c handles xdg_popup parented to a layer-shell surface. */
-static GtkWidget *
-build_wayland_layer_host (XAppStatusIcon *self,
-                          GtkMenu        *menu,
-                          gint            x,
-                          gint            y,
-                          gint            position,
-                          GdkWindow     **rect_window,
-                          GdkRectangle   *win_rect,
-                          GdkGravity     *rect_anchor,
-                          GdkGravity     *menu_anchor)
+static void
+position_wayland_layer_host (XAppStatusIcon *self,
+                             GtkMenu        *menu,
+                             gint            x,
+                             gint            y,
+                             gint            position,
+                             GdkWindow     **rect_window,
+                             GdkRectangle   *win_rect,
+                             GdkGravity     *rect_anchor,
+                             GdkGravity     *menu_anchor)
 {
     GtkWidget *host;
     GdkDisplay *display;
     GdkMonitor *monitor;
     GdkRectangle monitor_geom = { 0, 0, 0, 0 };
-    GdkVisual *visual;
     gint fx, fy;
     gint icon_size = self->priv->icon_size;
 
@@ -394,17 +611,6 @@ build_wayland_layer_host (XAppStatusIcon *self,
             break;
     }
 
-    host = gtk_window_new (GTK_WINDOW_TOPLEVEL);
-    gtk_widget_set_app_paintable (host, TRUE);
-    gtk_widget_set_size_request (host, icon_size, icon_size);
-    g_signal_connect (host, "draw", G_CALLBACK (layer_host_draw), NULL);
-
-    visual = gdk_screen_get_rgba_visual (gtk_widget_get_screen (host));
-    if (visual != NULL)
-    {
-        gtk_widget_set_visual (host, visual);
-    }
-
     display = gdk_display_get_default ();
     monitor = gdk_display_get_monitor_at_point (display, x, y);
     if (monitor != NULL)
@@ -412,27 +618,17 @@ build_wayland_layer_host (XAppStatusIcon *self,
         gdk_monitor_get_geometry (monitor, &monitor_geom);
     }
 
-    gtk_layer_init_for_window (GTK_WINDOW (host));
-    gtk_layer_set_namespace (GTK_WINDOW (host), "xapp-status-icon-popup");
-    gtk_layer_set_layer (GTK_WINDOW (host), GTK_LAYER_SHELL_LAYER_TOP);
-    /* The icon-owner's screen position is inside the panel/strut area, so we
-     * need to opt out of being moved into the workarea. -1 means "don't shift
-     * me to avoid struts" — the margin we set IS the final position. */
-    gtk_layer_set_exclusive_zone (GTK_WINDOW (host), -1);
-    gtk_layer_set_anchor (GTK_WINDOW (host), GTK_LAYER_SHELL_EDGE_TOP, TRUE);
-    gtk_layer_set_anchor (GTK_WINDOW (host), GTK_LAYER_SHELL_EDGE_LEFT, TRUE);
+    host = get_wayland_layer_host (display, monitor);
+
+    /* Icons can differ in size, so this may change from one popup to the next. */
+    gtk_widget_set_size_request (host, icon_size, icon_size);
+    gtk_window_resize (GTK_WINDOW (host), icon_size, icon_size);
+
     gtk_layer_set_margin (GTK_WINDOW (host), GTK_LAYER_SHELL_EDGE_TOP,
                           fy - monitor_geom.y);
     gtk_layer_set_margin (GTK_WINDOW (host), GTK_LAYER_SHELL_EDGE_LEFT,
                           fx - monitor_geom.x);
-    gtk_layer_set_keyboard_mode (GTK_WINDOW (host),
-                                 GTK_LAYER_SHELL_KEYBOARD_MODE_ON_DEMAND);
-    if (monitor != NULL)
-    {
-        gtk_layer_set_monitor (GTK_WINDOW (host), monitor);
-    }
 
-    gtk_widget_realize (host);
     gtk_widget_show (host);
 
     gtk_window_set_transient_for (GTK_WINDOW (gtk_widget_get_toplevel (GTK_WIDGET (menu))),
@@ -443,8 +639,6 @@ build_wayland_layer_host (XAppStatusIcon *self,
     win_rect->y = 0;
     win_rect->width = icon_size;
     win_rect->height = icon_size;
-
-    return host;
 }
 #endif /* HAVE_GTK_LAYER_SHELL */
 
@@ -462,6 +656,7 @@ popup_menu (XAppStatusIcon *self,
     GdkRectangle win_rect;
     GdkGravity rect_anchor, menu_anchor;
     gboolean use_layer_shell = FALSE;
+    gint64 trace_begin = XAPP_TRACE_CURRENT_TIME;
 
     DEBUG ("Popup menu on behalf of application");
 
@@ -474,8 +669,8 @@ popup_menu (XAppStatusIcon *self,
     use_layer_shell = should_use_layer_shell ();
     DEBUG ("Using gtk-layer-shell for popup: %s", use_layer_shell ? "Yes" : "No");
 
-    /* Under gtk-layer-shell the menu's xdg_popup is parented to a throwaway
-     * layer-shell host surface that we rebuild for each popup. Reusing the
+    /* Under gtk-layer-shell the menu's xdg_popup is parented to a layer-shell
+     * host surface, which is moved into place for each popup. Reusing the
      * menu's already-realized toplevel across popups leaves stale grab state
      * behind. Unrealizing first forces a fresh toplevel every time which
      * sidesteps the stale state. */
@@ -534,25 +729,24 @@ popup_menu (XAppStatusIcon *self,
 #ifdef HAVE_GTK_LAYER_SHELL
     if (use_layer_shell)
     {
-        GtkWidget *layer_host;
         GtkWidget *menu_toplevel;
         GdkWindow *menu_gdk_window;
         GdkDisplay *display = gdk_display_get_default ();
         GdkSeat *seat = gdk_display_get_default_seat (display);
 
         /* Make sure the menu's internal toplevel is realized so the transient
-         * parent set inside build_wayland_layer_host() actually reaches the
+         * parent set inside position_wayland_layer_host() actually reaches the
          * GDK level. gtk-layer-shell's move_to_rect override reads GDK-level
          * transient_for to find the layer-shell ancestor. */
         menu_toplevel = gtk_widget_get_toplevel (GTK_WIDGET (menu));
         gtk_widget_realize (menu_toplevel);
 
-        layer_host = build_wayland_layer_host (self, menu,
-                                               x, y, panel_position,
-                                               &rect_window,
-                                               &win_rect,
-                                               &rect_anchor,
-                                               &menu_anchor);
+        position_wayland_layer_host (self, menu,
+                                     x, y, panel_position,
+                                     &rect_window,
+                                     &win_rect,
+                                     &rect_anchor,
+                                     &menu_anchor);
 
         menu_gdk_window = gtk_widget_get_window (menu_toplevel);
         if (menu_gdk_window != NULL)
@@ -569,16 +763,6 @@ popup_menu (XAppStatusIcon *self,
         event = gdk_event_new (GDK_BUTTON_RELEASE);
         event->any.window = g_object_ref (rect_window);
         event->button.device = gdk_seat_get_pointer (seat);
-
-        g_object_set_data_full (G_OBJECT (menu),
-                                "xapp-layer-host",
-                                layer_host,
-                                (GDestroyNotify) gtk_widget_destroy);
-
-        g_signal_connect_after (gtk_widget_get_toplevel (GTK_WIDGET (menu)),
-                                "unmap",
-                                G_CALLBACK (layer_host_menu_unmapped),
-                                menu);
     }
     else
 #endif
@@ -592,6 +776,13 @@ popup_menu (XAppStatusIcon *self,
                                 (GDestroyNotify) gdk_window_destroy);
     }
 
+    g_signal_handlers_disconnect_by_func (gtk_widget_get_toplevel (GTK_WIDGET (menu)),
+                                          menu_mapped_trace, self);
+    g_signal_connect_object (gtk_widget_get_toplevel (GTK_WIDGET (menu)),
+                             "map",
+                             G_CALLBACK (menu_mapped_trace),
+                             self, 0);
+
     g_object_set (G_OBJECT (menu),
                   "anchor-hints", GDK_ANCHOR_SLIDE_X  | GDK_ANCHOR_SLIDE_Y  |
                                   GDK_ANCHOR_RESIZE_X | GDK_ANCHOR_RESIZE_Y,
@@ -605,6 +796,9 @@ popup_menu (XAppStatusIcon *self,
                             event);
 
     gdk_event_free (event);
+
+    XAPP_TRACE_MARK (trace_begin, "StatusIcon: popup menu",
+                     "%s, layer-shell: %d, time: %u", self->priv->name, use_layer_shell, _time);
 }
 
 static gboolean
@@ -653,43 +847,93 @@ get_menu_to_use (XAppStatusIcon *icon,
     return menu_to_use;
 }
 
-static gboolean
-handle_click_method (XAppStatusIconInterface *skeleton,
-                     GDBusMethodInvocation   *invocation,
-                     gint                     x,
-                     gint                     y,
-                     guint                    button,
-                     guint                    _time,
-                     gint                     panel_position,
-                     XAppStatusIcon          *icon)
+static void
+process_button_press (XAppStatusIcon *icon,
+                      gint            x,
+                      gint            y,
+                      guint           button,
+                      guint           _time,
+                      gint            panel_position,
+                      gint64          trace_begin)
 {
-    const gchar *name = g_dbus_method_invocation_get_method_name (invocation);
+    if (should_send_activate (icon, button))
+    {
+        DEBUG ("Native sending 'activate' for %s button", button_to_str (button));
+        g_signal_emit (icon, signals[ACTIVATE], 0,
+                       button,
+                       _time);
+    }
 
-    if (g_strcmp0 (name, "ButtonPress") == 0)
+    icon->priv->have_button_press = TRUE;
+    icon->priv->click_trace_begin = trace_begin;
+    icon->priv->click_trace_time = _time;
+
+    g_signal_emit (icon, signals[BUTTON_PRESS], 0,
+                   x, y,
+                   button,
+                   _time,
+                   panel_position);
+}
+
+static void
+process_button_release (XAppStatusIcon *icon,
+                        gint            x,
+                        gint            y,
+                        guint           button,
+                        guint           _time,
+                        gint            panel_position)
+{
+    if (icon->priv->have_button_press)
     {
-        DEBUG ("Received ButtonPress from monitor %s: "
-                 "pos:%d,%d , button: %s , time: %u , orientation: %s",
-                 g_dbus_method_invocation_get_sender (invocation),
-                 x, y, button_to_str (button), _time, panel_position_to_str (panel_position));
+        GtkWidget *menu_to_use = get_menu_to_use (icon, button);
 
-        if (should_send_activate (icon, button))
+        if (menu_to_use)
         {
-            DEBUG ("Native sending 'activate' for %s button", button_to_str (button));
-            g_signal_emit (icon, signals[ACTIVATE], 0,
-                           button,
-                           _time);
+            popup_menu (icon,
+                        GTK_MENU (menu_to_use),
+                        x, y,
+                        button,
+                        _time,
+                        panel_position);
         }
 
-        icon->priv->have_button_press = TRUE;
-
-        g_signal_emit (icon, signals[BUTTON_PRESS], 0,
+        g_signal_emit (icon, signals[BUTTON_RELEASE], 0,
                        x, y,
                        button,
                        _time,
                        panel_position);
+    }
+
+    icon->priv->have_button_press = FALSE;
+}
+
+static gboolean
+handle_button_method (XAppStatusIconInterface *skeleton,
+                      GDBusMethodInvocation   *invocation,
+                      gint                     x,
+                      gint                     y,
+                      guint                    button,
+                      guint                    _time,
+                      gint                     panel_position,
+                      XAppStatusIcon          *icon)
+{
+    const gchar *name = g_dbus_method_invocation_get_method_name (invocation);
+    gint64 trace_begin = XAPP_TRACE_CURRENT_TIME;
+
+    if (g_strcmp0 (name, "ButtonPress") == 0)
+    {
+        DEBUG ("Received ButtonPress from monitor %s: "
+                 "pos:%d,%d , button: %s , time: %u , orientation: %s",
+                 g_dbus_method_invocation_get_sender (invocation),
+                 x, y, button_to_str (button), _time, panel_position_to_str (panel_position));
+
+        process_button_press (icon, x, y, button, _time, panel_position, trace_begin);
 
         xapp_status_icon_interface_complete_button_press (skeleton,
                                                           invocation);
+
+        XAPP_TRACE_MARK (trace_begin, "StatusIcon: ButtonPress",
+                         "%s, button: %u, time: %u", icon->priv->name, button, _time);
     }
     else
     if (g_strcmp0 (name, "ButtonRelease") == 0)
@@ -699,36 +943,106 @@ handle_click_method (XAppStatusIconInterface *skeleton,
                  g_dbus_method_invocation_get_sender (invocation),
                  x, y, button_to_str (button), _time, panel_position_to_str (panel_position));
 
-        if (icon->priv->have_button_press)
-        {
-            GtkWidget *menu_to_use = get_menu_to_use (icon, button);
-
-            if (menu_to_use)
-            {
-                popup_menu (icon,
-                            GTK_MENU (menu_to_use),
-                            x, y,
-                            button,
-                            _time,
-                            panel_position);
-            }
-
-            g_signal_emit (icon, signals[BUTTON_RELEASE], 0,
-                           x, y,
-                           button,
-                           _time,
-                           panel_position);
-        }
-
-        icon->priv->have_button_press = FALSE;
+        process_button_release (icon, x, y, button, _time, panel_position);
 
         xapp_status_icon_interface_complete_button_release (skeleton,
                                                             invocation);
+
+        XAPP_TRACE_MARK (trace_begin, "StatusIcon: ButtonRelease",
+                         "%s, button: %u, time: %u", icon->priv->name, button, _time);
     }
 
     return TRUE;
 }
 
+/* A whole click in one call, from hosts that see SupportsClick. The press and
+ * release can't be reordered or separated, and it's one message instead of two. */
+static gboolean
+handle_click_method (XAppStatusIconInterface *skeleton,
+                     GDBusMethodInvocation   *invocation,
+                     gint                     x,
+                     gint                     y,
+                     guint                    button,
+                     guint                    press_time,
+                     guint                    release_time,
+                     gint                     panel_position,
+                     XAppStatusIcon          *icon)
+{
+    gint64 trace_begin = XAPP_TRACE_CURRENT_TIME;
+
+    DEBUG ("Received Click from monitor %s: "
+             "pos:%d,%d , button: %s , press time: %u , release time: %u , orientation: %s",
+             g_dbus_method_invocation_get_sender (invocation),
+             x, y, button_to_str (button), press_time, release_time,
+             panel_position_to_str (panel_position));
+
+    process_button_press (icon, x, y, button, press_time, panel_position, trace_begin);
+    process_button_release (icon, x, y, button, release_time, panel_position);
+
+    xapp_status_icon_interface_complete_click (skeleton,
+                                               invocation);
+
+    XAPP_TRACE_MARK (trace_begin, "StatusIcon: Click",
+                     "%s, button: %u, time: %u", icon->priv->name, button, release_time);
+
+    return TRUE;
+}
+
+static gboolean
+flush_scroll (gpointer user_data)
+{
+    XAppStatusIcon *icon = XAPP_STATUS_ICON (user_data);
+    XAppStatusIconPrivate *priv = icon->priv;
+    gint delta = priv->scroll_delta;
+
+    priv->scroll_idle_id = 0;
+    priv->scroll_delta = 0;
+
+    g_signal_emit (icon, signals[SCROLL], 0,
+                   delta,
+                   priv->scroll_direction,
+                   priv->scroll_time);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* A fast touchpad scroll can send dozens of these in a frame. If the app has asked
+ * for it, hold them until the main loop is idle (after any other queued calls are
+ * dispatched), and emit one scroll-event with the total. A change of direction
+ * sends what's pending first. */
+static void
+queue_scroll (XAppStatusIcon      *icon,
+              gint                 delta,
+              XAppScrollDirection  direction,
+              guint                _time)
+{
+    XAppStatusIconPrivate *priv = icon->priv;
+
+    if (!priv->scroll_coalescing)
+    {
+        g_signal_emit (icon, signals[SCROLL], 0,
+                       delta,
+                       direction,
+                       _time);
+        return;
+    }
+
+    if (priv->scroll_idle_id > 0 && priv->scroll_direction != direction)
+    {
+        g_source_remove (priv->scroll_idle_id);
+        flush_scroll (icon);
+    }
+
+    priv->scroll_delta += delta;
+    priv->scroll_direction = direction;
+    priv->scroll_time = _time;
+
+    if (priv->scroll_idle_id == 0)
+    {
+        priv->scroll_idle_id = g_idle_add (flush_scroll, icon);
+    }
+}
+
 static gboolean
 handle_scroll_method (XAppStatusIconInterface *skeleton,
                       GDBusMethodInvocation   *invocation,
@@ -742,10 +1056,7 @@ handle_scroll_method (XAppStatusIconInterface *skeleton,
              g_dbus_method_invocation_get_sender (invocation),
              delta, direction_to_str (direction), _time);
 
-    g_signal_emit(icon, signals[SCROLL], 0,
-                  delta,
-                  direction,
-                  _time);
+    queue_scroll (icon, delta, direction, _time);
 
     xapp_status_icon_interface_complete_scroll (skeleton,
                                                 invocation);
@@ -753,6 +1064,54 @@ handle_scroll_method (XAppStatusIconInterface *skeleton,
     return TRUE;
 }
 
+static gboolean
+handle_get_icon_pixels_method (XAppStatusIconInterface *skeleton,
+                               GDBusMethodInvocation   *invocation,
+                               GUnixFDList             *fd_list,
+                               XAppStatusIcon          *icon)
+{
+    XAppStatusIconPrivate *priv = icon->priv;
+    GUnixFDList *out_fd_list;
+    GError *error;
+    gint index;
+
+    DEBUG ("GetIconPixels: %dx%d (%s)", priv->pixels_width, priv->pixels_height, priv->name);
+
+    if (priv->pixels_fd < 0)
+    {
+        g_dbus_method_invocation_return_error_literal (invocation,
+                                                       G_IO_ERROR,
+                                                       G_IO_ERROR_NOT_FOUND,
+                                                       "No icon pixels have been set");
+        return TRUE;
+    }
+
+    error = NULL;
+    out_fd_list = g_unix_fd_list_new ();
+
+    // The list gets its own duplicate of the (sealed, read-only) descriptor.
+    index = g_unix_fd_list_append (out_fd_list, priv->pixels_fd, &error);
+
+    if (index < 0)
+    {
+        g_dbus_method_invocation_take_error (invocation, error);
+    }
+    else
+    {
+        xapp_status_icon_interface_complete_get_icon_pixels (skeleton,
+                                                             invocation,
+                                                             out_fd_list,
+                                                             index,
+                                                             priv->pixels_width,
+                                                             priv->pixels_height,
+                                                             priv->pixels_stride);
+    }
+
+    g_object_unref (out_fd_list);
+
+    return TRUE;
+}
+
 static void
 calculate_gtk_status_icon_position_and_orientation (XAppStatusIcon *icon,
                                                     GtkStatusIcon  *status_icon,
@@ -855,6 +1214,9 @@ on_gtk_status_icon_button_press (GtkStatusIcon *status_icon,
 
     icon->priv->have_button_press = TRUE;
 
+    icon->priv->click_trace_begin = XAPP_TRACE_CURRENT_TIME;
+    icon->priv->click_trace_time = _time;
+
     g_signal_emit (icon, signals[BUTTON_PRESS], 0,
                    x, y,
                    button,
@@ -960,47 +1322,12 @@ on_gtk_status_icon_scroll (GtkStatusIcon *status_icon,
                gtk_status_icon_get_title (status_icon),
                delta, direction_to_str (direction), _time);
 
-        g_signal_emit(icon, signals[SCROLL], 0,
-                      delta,
-                      x_dir,
-                      _time);
+        queue_scroll (icon, delta, x_dir, _time);
     }
 
     return GDK_EVENT_PROPAGATE;
 }
 
-static void
-name_owner_changed (GDBusConnection *connection,
-                    const gchar     *sender_name,
-                    const gchar     *object_path,
-                    const gchar     *interface_name,
-                    const gchar     *signal_name,
-                    GVariant        *parameters,
-                    gpointer         user_data)
-{
-    XAppStatusIcon *self = XAPP_STATUS_ICON (user_data);
-    DEBUG("NameOwnerChanged signal received, refreshing icon");
-
-    refresh_icon (self);
-}
-
-static void
-add_name_listener (XAppStatusIcon *self)
-{
-    DEBUG ("Adding NameOwnerChanged listener for status monitors");
-
-    self->priv->listener_id = g_dbus_connection_signal_subscribe (self->priv->connection,
-                                                                  FDO_DBUS_NAME,
-                                                                  FDO_DBUS_NAME,
-                                                                  "NameOwnerChanged",
-                                                                  FDO_DBUS_PATH,
-                                                                  STATUS_ICON_MONITOR_MATCH,
-                                                                  G_DBUS_SIGNAL_FLAGS_MATCH_ARG0_NAMESPACE,
-                                                                  name_owner_changed,
-                                                                  self,
-                                                                  NULL);
-}
-
 static void
 on_name_lost (GDBusConnection *connection,
               const gchar     *name,
@@ -1071,6 +1398,9 @@ sync_skeleton (XAppStatusIcon *self)
                   "tooltip-text", priv->tooltip_text,
                   "visible", priv->visible,
                   "metadata", priv->metadata,
+                  "icon-frames", priv->icon_frames ? (const gchar * const *) priv->icon_frames : no_frames,
+                  "frame-interval", priv->frame_interval,
+                  "icon-pixels-serial", priv->pixels_fd >= 0 ? priv->pixels_serial : 0,
                   NULL);
 
     g_dbus_interface_skeleton_flush (G_DBUS_INTERFACE_SKELETON (priv->interface_skeleton));
@@ -1116,9 +1446,11 @@ typedef struct
 
 static SkeletonSignal skeleton_signals[] = {
     // signal name                                callback
-    { "handle-button-press",                      handle_click_method },
-    { "handle-button-release",                    handle_click_method },
-    { "handle-scroll",                            handle_scroll_method }
+    { "handle-button-press",                      handle_button_method },
+    { "handle-button-release",                    handle_button_method },
+    { "handle-click",                             handle_click_method },
+    { "handle-scroll",                            handle_scroll_method },
+    { "handle-get-icon-pixels",                   handle_get_icon_pixels_method }
 };
 
 static void
@@ -1167,6 +1499,9 @@ export_icon_interface (XAppStatusIcon *self)
 
     self->priv->object_skeleton = xapp_object_skeleton_new (ICON_SUB_PATH);
     self->priv->interface_skeleton = xapp_status_icon_interface_skeleton_new ();
+    xapp_status_icon_interface_set_supports_click (self->priv->interface_skeleton, TRUE);
+    xapp_status_icon_interface_set_supports_scroll_coalescing (self->priv->interface_skeleton,
+                                                               self->priv->scroll_coalescing);
 
     xapp_object_skeleton_set_status_icon_interface (self->priv->object_skeleton,
                                                     self->priv->interface_skeleton);
@@ -1232,8 +1567,300 @@ connect_with_status_applet (XAppStatusIcon *self)
     g_free(owner_name);
 }
 
+static gboolean
+queue_property_update (XAppStatusIcon *self,
+                       DirtyFlags      flag)
+{
+    if (self->priv->update_depth == 0)
+    {
+        return FALSE;
+    }
+
+    self->priv->dirty |= flag;
+    return TRUE;
+}
+
 static void
-update_fallback_icon (XAppStatusIcon *self)
+set_fallback_frame (XAppStatusIcon *self)
+{
+    XAppStatusIconPrivate *priv = self->priv;
+    const gchar *frame;
+    GdkPixbuf *pixbuf;
+
+    frame = priv->icon_frames[priv->frame_index];
+
+    if (!g_path_is_absolute (frame))
+    {
+        gtk_status_icon_set_from_icon_name (priv->gtk_status_icon, frame);
+        return;
+    }
+
+    // Decode each frame file once, instead of on every pass through the animation.
+    if (priv->frame_pixbufs == NULL)
+    {
+        priv->frame_pixbufs = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                     g_free, g_object_unref);
+    }
+
+    pixbuf = g_hash_table_lookup (priv->frame_pixbufs, frame);
+
+    if (pixbuf == NULL)
+    {
+        GError *error = NULL;
+
+        pixbuf = gdk_pixbuf_new_from_file (frame, &error);
+
+        if (pixbuf == NULL)
+        {
+            DEBUG ("Could not load animation frame '%s': %s", frame, error->message);
+            g_error_free (error);
+
+            gtk_status_icon_set_from_icon_name (priv->gtk_status_icon, "image-missing");
+            return;
+        }
+
+        g_hash_table_insert (priv->frame_pixbufs, g_strdup (frame), pixbuf);
+    }
+
+    gtk_status_icon_set_from_pixbuf (priv->gtk_status_icon, pixbuf);
+}
+
+static gboolean
+on_fallback_frame_timeout (gpointer user_data)
+{
+    XAppStatusIcon *self = XAPP_STATUS_ICON (user_data);
+    XAppStatusIconPrivate *priv = self->priv;
+
+    if (priv->gtk_status_icon == NULL || priv->icon_frames == NULL || !priv->visible)
+    {
+        priv->frame_timer_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    priv->frame_index = (priv->frame_index + 1) % priv->n_frames;
+    set_fallback_frame (self);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+ensure_fallback_animation (XAppStatusIcon *self)
+{
+    XAppStatusIconPrivate *priv = self->priv;
+
+    if (priv->frame_timer_id > 0 || priv->n_frames < 2 || !priv->visible)
+    {
+        return;
+    }
+
+    priv->frame_timer_id = g_timeout_add (priv->frame_interval,
+                                          on_fallback_frame_timeout,
+                                          self);
+}
+
+static void
+clear_animation (XAppStatusIcon *self)
+{
+    XAppStatusIconPrivate *priv = self->priv;
+
+    if (priv->frame_timer_id > 0)
+    {
+        g_source_remove (priv->frame_timer_id);
+        priv->frame_timer_id = 0;
+    }
+
+    g_clear_pointer (&priv->frame_pixbufs, g_hash_table_unref);
+    g_clear_pointer (&priv->icon_frames, g_strfreev);
+
+    priv->n_frames = 0;
+    priv->frame_interval = 0;
+    priv->frame_index = 0;
+}
+
+static gboolean
+clear_icon_pixels (XAppStatusIcon *self)
+{
+    XAppStatusIconPrivate *priv = self->priv;
+
+    if (priv->icon_pixbuf == NULL)
+    {
+        return FALSE;
+    }
+
+    g_clear_object (&priv->icon_pixbuf);
+
+    if (priv->pixels_fd >= 0)
+    {
+        close (priv->pixels_fd);
+        priv->pixels_fd = -1;
+    }
+
+    priv->pixels_width = priv->pixels_height = priv->pixels_stride = 0;
+
+    return TRUE;
+}
+
+#ifdef HAVE_MEMFD_CREATE
+static gint
+create_pixels_memfd (cairo_surface_t  *surface,
+                     GError          **error)
+{
+    const guchar *data;
+    gsize size, written;
+    gint fd;
+
+    cairo_surface_flush (surface);
+
+    data = cairo_image_surface_get_data (surface);
+    size = (gsize) cairo_image_surface_get_stride (surface) * cairo_image_surface_get_height (surface);
+
+    fd = memfd_create ("xapp-status-icon-pixels", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+    if (fd < 0)
+    {
+        goto failed;
+    }
+
+    written = 0;
+
+    while (written < size)
+    {
+        gssize n = write (fd, data + written, size - written);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            goto failed;
+        }
+
+        written += n;
+    }
+
+    // Once sealed, the applet can map the buffer knowing it can never
+    // change size or content underneath it.
+    if (fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0)
+    {
+        goto failed;
+    }
+
+    return fd;
+
+failed:
+    {
+        int errsv = errno;
+
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                     "Could not create icon pixel buffer: %s", g_strerror (errsv));
+
+        if (fd >= 0)
+        {
+            close (fd);
+        }
+
+        return -1;
+    }
+}
+#endif
+
+static void
+cached_pixbuf_free (CachedPixbuf *cached)
+{
+    g_free (cached->path);
+    g_object_unref (cached->pixbuf);
+    g_slice_free (CachedPixbuf, cached);
+}
+
+static GdkPixbuf *
+load_fallback_pixbuf (const gchar *path)
+{
+    GFile *file;
+    GFileInfo *info;
+    GList *l;
+    CachedPixbuf *cached;
+    GdkPixbuf *pixbuf;
+    GError *error;
+    guint64 mtime;
+    guint32 mtime_usec;
+    goffset size;
+
+    error = NULL;
+
+    file = g_file_new_for_path (path);
+    info = g_file_query_info (file,
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+                              G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                              G_FILE_QUERY_INFO_NONE,
+                              NULL,
+                              &error);
+    g_object_unref (file);
+
+    if (info == NULL)
+    {
+        DEBUG ("Could not stat icon file '%s': %s", path, error->message);
+        g_error_free (error);
+        return NULL;
+    }
+
+    mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    mtime_usec = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+    size = g_file_info_get_size (info);
+    g_object_unref (info);
+
+    for (l = fallback_pixbuf_cache.head; l != NULL; l = l->next)
+    {
+        cached = (CachedPixbuf *) l->data;
+
+        if (g_strcmp0 (cached->path, path) != 0)
+        {
+            continue;
+        }
+
+        if (cached->mtime == mtime && cached->mtime_usec == mtime_usec && cached->size == size)
+        {
+            g_queue_unlink (&fallback_pixbuf_cache, l);
+            g_queue_push_head_link (&fallback_pixbuf_cache, l);
+
+            return g_object_ref (cached->pixbuf);
+        }
+
+        // The file has been rewritten since.
+        g_queue_delete_link (&fallback_pixbuf_cache, l);
+        cached_pixbuf_free (cached);
+        break;
+    }
+
+    pixbuf = gdk_pixbuf_new_from_file (path, &error);
+
+    if (pixbuf == NULL)
+    {
+        DEBUG ("Could not load icon file '%s': %s", path, error->message);
+        g_error_free (error);
+        return NULL;
+    }
+
+    cached = g_slice_new0 (CachedPixbuf);
+    cached->path = g_strdup (path);
+    cached->mtime = mtime;
+    cached->mtime_usec = mtime_usec;
+    cached->size = size;
+    cached->pixbuf = g_object_ref (pixbuf);
+
+    g_queue_push_head (&fallback_pixbuf_cache, cached);
+
+    while (g_queue_get_length (&fallback_pixbuf_cache) > FALLBACK_PIXBUF_CACHE_SIZE)
+    {
+        cached_pixbuf_free (g_queue_pop_tail (&fallback_pixbuf_cache));
+    }
+
+    return pixbuf;
+}
+
+static void
+update_fallback_icon (XAppStatusIcon *self,
+                      FallbackFlags   changed)
 {
     XAppStatusIconPrivate *priv = self->priv;
 
@@ -1242,24 +1869,206 @@ update_fallback_icon (XAppStatusIcon *self)
         return;
     }
 
-    gtk_status_icon_set_tooltip_text (priv->gtk_status_icon, priv->tooltip_text);
+    if (queue_property_update (self, DIRTY_FALLBACK))
+    {
+        priv->fallback_dirty |= changed;
+        return;
+    }
+
+    if (changed & FALLBACK_TOOLTIP)
+    {
+        gtk_status_icon_set_tooltip_text (priv->gtk_status_icon, priv->tooltip_text);
+    }
+
+    if ((changed & (FALLBACK_VISIBLE | FALLBACK_IMAGE)) == 0)
+    {
+        return;
+    }
 
-    if (priv->icon_name)
+    if (priv->icon_name == NULL)
     {
-        gtk_status_icon_set_visible (priv->gtk_status_icon, priv->visible);
+        gtk_status_icon_set_visible (priv->gtk_status_icon, FALSE);
+        return;
+    }
+
+    gtk_status_icon_set_visible (priv->gtk_status_icon, priv->visible);
 
-        if (g_path_is_absolute (priv->icon_name))
+    if (changed & FALLBACK_IMAGE)
+    {
+        if (priv->icon_pixbuf != NULL)
+        {
+            gtk_status_icon_set_from_pixbuf (priv->gtk_status_icon, priv->icon_pixbuf);
+        }
+        else if (priv->icon_frames != NULL)
         {
-            gtk_status_icon_set_from_file (priv->gtk_status_icon, priv->icon_name);
+            set_fallback_frame (self);
+        }
+        else if (g_path_is_absolute (priv->icon_name))
+        {
+            GdkPixbuf *pixbuf = load_fallback_pixbuf (priv->icon_name);
+
+            if (pixbuf != NULL)
+            {
+                gtk_status_icon_set_from_pixbuf (priv->gtk_status_icon, pixbuf);
+                g_object_unref (pixbuf);
+            }
+            else
+            {
+                gtk_status_icon_set_from_file (priv->gtk_status_icon, priv->icon_name);
+            }
         }
         else
         {
             gtk_status_icon_set_from_icon_name (priv->gtk_status_icon, priv->icon_name);
         }
     }
+
+    if (priv->icon_frames != NULL)
+    {
+        ensure_fallback_animation (self);
+    }
+}
+
+static void
+push_skeleton_properties (XAppStatusIcon *self,
+                          DirtyFlags      dirty)
+{
+    XAppStatusIconPrivate *priv = self->priv;
+    XAppStatusIconInterface *skeleton = priv->interface_skeleton;
+
+    if (skeleton == NULL || (dirty & ~DIRTY_FALLBACK) == DIRTY_NONE)
+    {
+        return;
+    }
+
+    if (dirty & DIRTY_NAME)
+        xapp_status_icon_interface_set_name (skeleton, priv->name);
+    if (dirty & DIRTY_ICON_NAME)
+        xapp_status_icon_interface_set_icon_name (skeleton, priv->icon_name);
+    if (dirty & DIRTY_TOOLTIP_TEXT)
+        xapp_status_icon_interface_set_tooltip_text (skeleton, priv->tooltip_text);
+    if (dirty & DIRTY_LABEL)
+        xapp_status_icon_interface_set_label (skeleton, priv->label);
+    if (dirty & DIRTY_VISIBLE)
+        xapp_status_icon_interface_set_visible (skeleton, priv->visible);
+    if (dirty & DIRTY_METADATA)
+        xapp_status_icon_interface_set_metadata (skeleton, priv->metadata);
+    if (dirty & DIRTY_ANIMATION)
+    {
+        xapp_status_icon_interface_set_icon_frames (skeleton,
+                                                    priv->icon_frames ? (const gchar * const *) priv->icon_frames : no_frames);
+        xapp_status_icon_interface_set_frame_interval (skeleton, priv->frame_interval);
+    }
+    if (dirty & DIRTY_PIXELS)
+        xapp_status_icon_interface_set_icon_pixels_serial (skeleton,
+                                                           priv->pixels_fd >= 0 ? priv->pixels_serial : 0);
+
+    // Send everything out now as a single PropertiesChanged signal.
+    g_dbus_interface_skeleton_flush (G_DBUS_INTERFACE_SKELETON (skeleton));
+}
+
+static void
+send_throttled_updates (XAppStatusIcon *self)
+{
+    XAppStatusIconPrivate *priv = self->priv;
+    DirtyFlags throttled;
+
+    throttled = priv->throttled;
+    priv->throttled = DIRTY_NONE;
+
+    priv->last_throttled_update = g_get_monotonic_time ();
+
+    DEBUG ("Sending held back updates (%s): 0x%x", priv->name, throttled);
+
+    push_skeleton_properties (self, throttled);
+}
+
+static gboolean
+on_throttle_timeout (gpointer user_data)
+{
+    XAppStatusIcon *self = XAPP_STATUS_ICON (user_data);
+    XAppStatusIconPrivate *priv = self->priv;
+
+    priv->throttle_id = 0;
+
+    // Don't split up a batch that's in progress - hand the held back
+    // properties to it instead, they'll go out when it ends.
+    if (priv->update_depth > 0)
+    {
+        priv->dirty |= priv->throttled;
+        priv->throttled = DIRTY_NONE;
+    }
     else
     {
-        gtk_status_icon_set_visible (priv->gtk_status_icon, FALSE);
+        send_throttled_updates (self);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+// Applies the rate limit set by xapp_status_icon_set_update_rate_limit().
+// Returns the subset of @dirty that can be sent now - anything held back
+// is sent later by a timeout, with whatever the latest values are then.
+static DirtyFlags
+throttle_property_updates (XAppStatusIcon *self,
+                           DirtyFlags      dirty)
+{
+    XAppStatusIconPrivate *priv = self->priv;
+    DirtyFlags limited;
+    gint64 now, next;
+
+    limited = dirty & THROTTLED_FLAGS;
+
+    if (priv->rate_limit == 0 || limited == DIRTY_NONE)
+    {
+        return dirty;
+    }
+
+    if (priv->throttle_id == 0)
+    {
+        now = g_get_monotonic_time ();
+        next = priv->last_throttled_update + (G_USEC_PER_SEC / priv->rate_limit);
+
+        if (now >= next)
+        {
+            priv->last_throttled_update = now;
+            return dirty;
+        }
+
+        priv->throttle_id = g_timeout_add ((next - now + 999) / 1000,
+                                           on_throttle_timeout,
+                                           self);
+    }
+
+    priv->throttled |= limited;
+
+    return dirty & ~limited;
+}
+
+static void
+flush_property_updates (XAppStatusIcon *self)
+{
+    XAppStatusIconPrivate *priv = self->priv;
+    DirtyFlags dirty;
+
+    dirty = priv->dirty;
+    priv->dirty = DIRTY_NONE;
+
+    if (dirty == DIRTY_NONE)
+    {
+        return;
+    }
+
+    DEBUG ("Flushing batched property updates (%s): 0x%x", priv->name, dirty);
+
+    push_skeleton_properties (self, throttle_property_updates (self, dirty));
+
+    if (dirty & DIRTY_FALLBACK)
+    {
+        FallbackFlags changed = priv->fallback_dirty;
+
+        priv->fallback_dirty = 0;
+        update_fallback_icon (self, changed);
     }
 }
 
@@ -1318,7 +2127,91 @@ use_gtk_status_icon (XAppStatusIcon *self)
                       G_CALLBACK (on_gtk_status_icon_embedded_changed),
                       self);
 
-    update_fallback_icon (self);
+    update_fallback_icon (self, FALLBACK_ALL);
+}
+
+static void
+applet_state_known (XAppStatusIcon *self,
+                    gboolean        found)
+{
+    if (found && export_icon_interface (self))
+    {
+        if (name_owner_id > 0)
+        {
+            sync_skeleton (self);
+        }
+        else
+        {
+            connect_with_status_applet (self);
+        }
+    }
+    else
+    {
+        use_gtk_status_icon (self);
+    }
+}
+
+static MonitorsWatch *
+find_monitors_watch (guint watch_id)
+{
+    GList *l;
+
+    for (l = monitors_watches; l != NULL; l = l->next)
+    {
+        MonitorsWatch *watch = l->data;
+
+        if (watch->id == watch_id)
+        {
+            return watch;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+applet_watcher_update_state (AppletWatcher *watcher,
+                             GList         *icons)
+{
+    gboolean had_monitors;
+    GArray *watch_ids;
+    GList *l;
+    guint i;
+
+    had_monitors = watcher->have_monitors;
+    watcher->have_monitors = g_hash_table_size (watcher->monitors) > 0;
+
+    if (had_monitors == watcher->have_monitors)
+    {
+        return;
+    }
+
+    DEBUG ("Status monitors are now %s", watcher->have_monitors ? "present" : "gone");
+
+    for (l = icons; l != NULL; l = l->next)
+    {
+        g_signal_emit (l->data, signals[MONITORS_CHANGED], 0, watcher->have_monitors);
+    }
+
+    // Callbacks can remove watches (their own or others), so go by id.
+    watch_ids = g_array_new (FALSE, FALSE, sizeof (guint));
+
+    for (l = monitors_watches; l != NULL; l = l->next)
+    {
+        g_array_append_val (watch_ids, ((MonitorsWatch *) l->data)->id);
+    }
+
+    for (i = 0; i < watch_ids->len; i++)
+    {
+        MonitorsWatch *watch = find_monitors_watch (g_array_index (watch_ids, guint, i));
+
+        if (watch != NULL)
+        {
+            watch->callback (watcher->have_monitors, watch->user_data);
+        }
+    }
+
+    g_array_unref (watch_ids);
 }
 
 static void
@@ -1326,9 +2219,10 @@ on_list_names_completed (GObject      *source,
                          GAsyncResult *res,
                          gpointer      user_data)
 {
-    XAppStatusIcon *self = XAPP_STATUS_ICON(user_data);
+    AppletWatcher *watcher;
     GVariant *result;
     GVariantIter *iter;
+    GList *icons, *l;
     gchar *str;
     GError *error;
     gboolean found;
@@ -1339,66 +2233,218 @@ on_list_names_completed (GObject      *source,
                                             res,
                                             &error);
 
+    if (error != NULL && error->code == G_IO_ERROR_CANCELLED)
+    {
+        // The watcher is already gone.
+        DEBUG ("Attempt to ListNames cancelled");
+        g_error_free (error);
+        return;
+    }
+
+    watcher = (AppletWatcher *) user_data;
+    watcher->listing = FALSE;
+
     if (error != NULL)
     {
-        if (error->code != G_IO_ERROR_CANCELLED)
+        g_critical ("XAppStatusIcon: attempt to ListNames failed: %s\n", error->message);
+    }
+    else
+    {
+        g_hash_table_remove_all (watcher->monitors);
+
+        g_variant_get (result, "(as)", &iter);
+
+        while (g_variant_iter_loop (iter, "s", &str))
         {
-            g_critical ("XAppStatusIcon: attempt to ListNames failed: %s\n", error->message);
-            use_gtk_status_icon (self);
+            if (g_str_has_prefix (str, STATUS_ICON_MONITOR_MATCH))
+            {
+                DEBUG ("Discovered active status monitor (%s)", str);
+                g_hash_table_add (watcher->monitors, g_strdup (str));
+            }
+        }
+
+        g_variant_iter_free (iter);
+        g_variant_unref (result);
+
+        watcher->have_monitor_list = TRUE;
+    }
+
+    found = g_hash_table_size (watcher->monitors) > 0;
+
+    for (l = watcher->tasks; l != NULL; l = l->next)
+    {
+        GTask *task = G_TASK (l->data);
+
+        if (error != NULL)
+        {
+            g_task_return_error (task, g_error_copy (error));
         }
         else
         {
-            DEBUG ("Attempt to ListNames cancelled");
+            g_task_return_boolean (task, found);
         }
-
-        g_error_free (error);
-        return;
     }
 
-    g_variant_get (result, "(as)", &iter);
+    g_list_free_full (watcher->tasks, g_object_unref);
+    watcher->tasks = NULL;
 
-    found = FALSE;
+    // Icons can be unreffed by handlers along the way - the last one
+    // would also free the watcher, so don't touch it after this.
+    icons = g_list_copy_deep (watcher->icons, (GCopyFunc) g_object_ref, NULL);
+
+    if (error == NULL)
+    {
+        applet_watcher_update_state (watcher, icons);
+    }
 
-    while (g_variant_iter_loop (iter, "s", &str))
+    for (l = icons; l != NULL; l = l->next)
     {
-        if (g_str_has_prefix (str, STATUS_ICON_MONITOR_MATCH))
+        XAppStatusIcon *icon = XAPP_STATUS_ICON (l->data);
+
+        if (!icon->priv->awaiting_applet_state)
         {
-            DEBUG ("Discovered active status monitor (%s)", str);
-            found = TRUE;
+            continue;
         }
-    }
 
-    g_variant_iter_free (iter);
-    g_variant_unref (result);
+        icon->priv->awaiting_applet_state = FALSE;
 
-    if (found && export_icon_interface (self))
-    {
-        if (name_owner_id > 0)
+        if (error != NULL)
         {
-            sync_skeleton (self);
+            use_gtk_status_icon (icon);
         }
         else
         {
-            connect_with_status_applet (self);
-
-            return;
+            applet_state_known (icon, found);
         }
     }
+
+    g_list_free_full (icons, g_object_unref);
+    g_clear_error (&error);
+}
+
+static void
+name_owner_changed (GDBusConnection *connection,
+                    const gchar     *sender_name,
+                    const gchar     *object_path,
+                    const gchar     *interface_name,
+                    const gchar     *signal_name,
+                    GVariant        *parameters,
+                    gpointer         user_data)
+{
+    AppletWatcher *watcher = (AppletWatcher *) user_data;
+    const gchar *name, *old_owner, *new_owner;
+    GList *icons, *l;
+
+    g_variant_get (parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+
+    DEBUG("NameOwnerChanged signal received (%s), refreshing icons", name);
+
+    if (new_owner[0] != '\0')
+    {
+        g_hash_table_add (watcher->monitors, g_strdup (name));
+    }
     else
     {
-        use_gtk_status_icon (self);
+        g_hash_table_remove (watcher->monitors, name);
     }
+
+    icons = g_list_copy_deep (watcher->icons, (GCopyFunc) g_object_ref, NULL);
+
+    for (l = icons; l != NULL; l = l->next)
+    {
+        refresh_icon (XAPP_STATUS_ICON (l->data));
+    }
+
+    if (watcher->have_monitor_list)
+    {
+        applet_watcher_update_state (watcher, icons);
+    }
+
+    g_list_free_full (icons, g_object_unref);
 }
 
 static void
-look_for_status_applet (XAppStatusIcon *self)
+applet_watcher_ensure (GDBusConnection *connection)
+{
+    if (applet_watcher == NULL)
+    {
+        DEBUG ("Adding NameOwnerChanged listener for status monitors");
+
+        applet_watcher = g_slice_new0 (AppletWatcher);
+        applet_watcher->connection = g_object_ref (connection);
+        applet_watcher->cancellable = g_cancellable_new ();
+        applet_watcher->monitors = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+        applet_watcher->listener_id = g_dbus_connection_signal_subscribe (applet_watcher->connection,
+                                                                          FDO_DBUS_NAME,
+                                                                          FDO_DBUS_NAME,
+                                                                          "NameOwnerChanged",
+                                                                          FDO_DBUS_PATH,
+                                                                          STATUS_ICON_MONITOR_MATCH,
+                                                                          G_DBUS_SIGNAL_FLAGS_MATCH_ARG0_NAMESPACE,
+                                                                          name_owner_changed,
+                                                                          applet_watcher,
+                                                                          NULL);
+    }
+}
+
+static void
+applet_watcher_add_icon (XAppStatusIcon *self)
+{
+    applet_watcher_ensure (self->priv->connection);
+
+    if (g_list_find (applet_watcher->icons, self) == NULL)
+    {
+        applet_watcher->icons = g_list_prepend (applet_watcher->icons, self);
+    }
+}
+
+static void
+applet_watcher_remove_icon (XAppStatusIcon *self)
+{
+    AppletWatcher *watcher = applet_watcher;
+
+    if (watcher == NULL || g_list_find (watcher->icons, self) == NULL)
+    {
+        return;
+    }
+
+    watcher->icons = g_list_remove (watcher->icons, self);
+    self->priv->awaiting_applet_state = FALSE;
+
+    if (watcher->icons != NULL || watcher->keep_alive)
+    {
+        return;
+    }
+
+    DEBUG ("Final icon removed, removing status monitor listener");
+
+    g_cancellable_cancel (watcher->cancellable);
+    g_object_unref (watcher->cancellable);
+
+    g_dbus_connection_signal_unsubscribe (watcher->connection, watcher->listener_id);
+    g_object_unref (watcher->connection);
+
+    g_hash_table_unref (watcher->monitors);
+
+    g_slice_free (AppletWatcher, watcher);
+    applet_watcher = NULL;
+}
+
+static void
+applet_watcher_list_names (AppletWatcher *watcher)
 {
+    if (watcher->listing)
+    {
+        return;
+    }
+
     // Check that there is at least one applet on DBUS
     DEBUG("Looking for status monitors");
 
-    cancellable_reset (self);
+    watcher->listing = TRUE;
 
-    g_dbus_connection_call (self->priv->connection,
+    g_dbus_connection_call (watcher->connection,
                             FDO_DBUS_NAME,
                             FDO_DBUS_PATH,
                             FDO_DBUS_NAME,
@@ -1407,18 +2453,53 @@ look_for_status_applet (XAppStatusIcon *self)
                             G_VARIANT_TYPE ("(as)"),
                             G_DBUS_CALL_FLAGS_NONE,
                             3000, /* 3 secs */
-                            self->priv->cancellable,
+                            watcher->cancellable,
                             on_list_names_completed,
-                            self);
+                            watcher);
+}
+
+static void
+applet_watcher_query (GTask *task)
+{
+    AppletWatcher *watcher = applet_watcher;
+
+    watcher->keep_alive = TRUE;
+
+    if (watcher->have_monitor_list)
+    {
+        g_task_return_boolean (task, watcher->have_monitors);
+        g_object_unref (task);
+        return;
+    }
+
+    watcher->tasks = g_list_append (watcher->tasks, task);
+    applet_watcher_list_names (watcher);
+}
+
+static void
+look_for_status_applet (XAppStatusIcon *self)
+{
+    AppletWatcher *watcher = applet_watcher;
+
+    // Monitors coming and going are tracked with NameOwnerChanged, so once the
+    // initial list has been fetched, the answer is always at hand.
+    if (watcher->have_monitor_list)
+    {
+        DEBUG ("Status monitors present: %s", g_hash_table_size (watcher->monitors) > 0 ? "TRUE" : "FALSE");
+
+        applet_state_known (self, g_hash_table_size (watcher->monitors) > 0);
+        return;
+    }
+
+    self->priv->awaiting_applet_state = TRUE;
+
+    applet_watcher_list_names (watcher);
 }
 
 static void
 complete_icon_setup (XAppStatusIcon *self)
 {
-    if (self->priv->listener_id == 0)
-        {
-            add_name_listener (self);
-        }
+    applet_watcher_add_icon (self);
 
     /* There is a potential loop in the g_bus_own_name sequence -
      * if we fail to acquire a name, we refresh again and potentially
@@ -1518,6 +2599,9 @@ xapp_status_icon_set_property (GObject    *object,
 
             xapp_status_icon_set_name (XAPP_STATUS_ICON (object), g_value_get_string (value));
             break;
+        case PROP_SCROLL_COALESCING:
+            xapp_status_icon_set_scroll_coalescing (XAPP_STATUS_ICON (object), g_value_get_boolean (value));
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
             break;
@@ -1546,6 +2630,9 @@ xapp_status_icon_get_property (GObject    *object,
         case PROP_NAME:
             g_value_set_string (value, icon->priv->name);
             break;
+        case PROP_SCROLL_COALESCING:
+            g_value_set_boolean (value, icon->priv->scroll_coalescing);
+            break;
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
             break;
@@ -1567,6 +2654,8 @@ xapp_status_icon_init (XAppStatusIcon *self)
     // Default to visible (the same behavior as GtkStatusIcon)
     self->priv->visible = TRUE;
 
+    self->priv->pixels_fd = -1;
+
     refresh_icon (self);
 }
 
@@ -1605,6 +2694,21 @@ xapp_status_icon_dispose (GObject *object)
     g_free (self->priv->label);
     g_free (self->priv->metadata);
 
+    clear_animation (self);
+    clear_icon_pixels (self);
+
+    if (self->priv->throttle_id > 0)
+    {
+        g_source_remove (self->priv->throttle_id);
+        self->priv->throttle_id = 0;
+    }
+
+    if (self->priv->scroll_idle_id > 0)
+    {
+        g_source_remove (self->priv->scroll_idle_id);
+        self->priv->scroll_idle_id = 0;
+    }
+
     g_clear_object (&self->priv->cancellable);
 
     g_clear_object (&self->priv->primary_menu);
@@ -1618,11 +2722,7 @@ xapp_status_icon_dispose (GObject *object)
 
     remove_icon_path_from_bus (self);
 
-    if (self->priv->listener_id > 0)
-    {
-        g_dbus_connection_signal_unsubscribe (self->priv->connection, self->priv->listener_id);
-        self->priv->listener_id = 0;
-    }
+    applet_watcher_remove_icon (self);
 
     g_clear_object (&self->priv->connection);
 
@@ -1742,6 +2842,23 @@ xapp_status_icon_class_init (XAppStatusIconClass *klass)
                                                           NULL,
                                                           G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
 
+    /**
+     * XAppStatusIcon:scroll-coalescing:
+     *
+     * Whether scrolls that arrive in quick succession, in the same direction, are
+     * combined into one #XAppStatusIcon::scroll-event, with an amount that's their
+     * sum. This also tells applets that they can send several steps of scrolling at
+     * once, rather than one at a time.
+     *
+     * Since: 3.4
+     */
+    g_object_class_install_property (gobject_class, PROP_SCROLL_COALESCING,
+                                     g_param_spec_boolean ("scroll-coalescing",
+                                                           "Scroll coalescing",
+                                                           "Whether scrolls are combined",
+                                                           FALSE,
+                                                           G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY));
+
     /**
      * XAppStatusIcon::button-press-event:
      * @icon: The #XAppStatusIcon
@@ -1826,6 +2943,9 @@ xapp_status_icon_class_init (XAppStatusIconClass *klass)
      * Gets emitted when the user uses the mouse scroll wheel over the status icon.
      * For the most part, amounts will always be 1, unless an applet supports smooth
      * scrolling.  Generally the direction value is most important.
+     *
+     * If #XAppStatusIcon:scroll-coalescing is set, scrolls in the same direction that
+     * arrive in quick succession are combined, and @amount is their sum.
      */
     signals [SCROLL] =
         g_signal_new ("scroll-event",
@@ -1834,6 +2954,25 @@ xapp_status_icon_class_init (XAppStatusIconClass *klass)
                       0,
                       NULL, NULL, NULL,
                       G_TYPE_NONE, 3, G_TYPE_INT, XAPP_TYPE_SCROLL_DIRECTION, G_TYPE_UINT);
+
+    /**
+     * XAppStatusIcon::monitors-changed:
+     * @icon: The #XAppStatusIcon
+     * @have_monitors: Whether there are any #XAppStatusIconMonitors on the bus now
+     *
+     * Gets emitted when the first #XAppStatusIconMonitor appears on the bus, or
+     * the last one disappears. This is the same answer xapp_status_icon_any_monitors()
+     * gives, so there's no need to poll that.
+     *
+     * Since: 3.4
+     */
+    signals [MONITORS_CHANGED] =
+        g_signal_new ("monitors-changed",
+                      XAPP_TYPE_STATUS_ICON,
+                      G_SIGNAL_RUN_LAST,
+                      0,
+                      NULL, NULL, NULL,
+                      G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
 }
 
 /**
@@ -1869,7 +3008,7 @@ xapp_status_icon_set_name (XAppStatusIcon *icon, const gchar *name)
 
     DEBUG ("set_name: %s", name);
 
-    if (icon->priv->interface_skeleton)
+    if (!queue_property_update (icon, DIRTY_NAME) && icon->priv->interface_skeleton)
     {
         xapp_status_icon_interface_set_name (icon->priv->interface_skeleton, name);
     }
@@ -1898,22 +3037,199 @@ xapp_status_icon_set_icon_name (XAppStatusIcon *icon, const gchar *icon_name)
 {
     g_return_if_fail (XAPP_IS_STATUS_ICON (icon));
 
-    if (g_strcmp0 (icon_name, icon->priv->icon_name) == 0)
+    if (icon->priv->icon_frames == NULL &&
+        icon->priv->icon_pixbuf == NULL &&
+        g_strcmp0 (icon_name, icon->priv->icon_name) == 0)
     {
         return;
     }
 
-    g_clear_pointer (&icon->priv->icon_name, g_free);
-    icon->priv->icon_name = g_strdup (icon_name);
-
     DEBUG ("set_icon_name: %s", icon_name);
 
-    if (icon->priv->interface_skeleton)
+    xapp_status_icon_begin_update (icon);
+
+    if (clear_icon_pixels (icon))
+    {
+        queue_property_update (icon, DIRTY_PIXELS);
+    }
+
+    if (icon->priv->icon_frames != NULL)
+    {
+        clear_animation (icon);
+        queue_property_update (icon, DIRTY_ANIMATION);
+    }
+
+    if (g_strcmp0 (icon_name, icon->priv->icon_name) != 0)
+    {
+        g_clear_pointer (&icon->priv->icon_name, g_free);
+        icon->priv->icon_name = g_strdup (icon_name);
+
+        queue_property_update (icon, DIRTY_ICON_NAME);
+    }
+
+    update_fallback_icon (icon, FALLBACK_IMAGE);
+
+    xapp_status_icon_end_update (icon);
+}
+
+/**
+ * xapp_status_icon_set_animation:
+ * @icon: a #XAppStatusIcon
+ * @frames: (nullable) (array zero-terminated=1): icon names or absolute paths
+ * to icons, one for each frame of the animation.
+ * @interval_ms: the time each frame is shown for, in milliseconds.
+ *
+ * Sets a sequence of icons to cycle through. The whole sequence is sent to the
+ * host once, and the host runs the animation itself - this is much cheaper than
+ * calling xapp_status_icon_set_icon_name() for every frame. The icon name is set
+ * to the first frame, for hosts that don't support animations.
+ *
+ * Passing %NULL or an empty list for @frames (or 0 for @interval_ms) stops the animation
+ * and leaves the current icon in place. Calling xapp_status_icon_set_icon_name() will
+ * also stop it.
+ *
+ * Since: 3.4
+ */
+void
+xapp_status_icon_set_animation (XAppStatusIcon      *icon,
+                                const gchar * const *frames,
+                                guint                interval_ms)
+{
+    g_return_if_fail (XAPP_IS_STATUS_ICON (icon));
+    XAppStatusIconPrivate *priv = icon->priv;
+
+    xapp_status_icon_begin_update (icon);
+
+    clear_animation (icon);
+
+    if (clear_icon_pixels (icon))
+    {
+        queue_property_update (icon, DIRTY_PIXELS);
+    }
+
+    if (frames != NULL && frames[0] != NULL && interval_ms > 0)
+    {
+        priv->icon_frames = g_strdupv ((gchar **) frames);
+        priv->n_frames = g_strv_length (priv->icon_frames);
+        priv->frame_interval = interval_ms;
+
+        DEBUG ("set_animation: %u frames, %ums interval", priv->n_frames, interval_ms);
+
+        if (g_strcmp0 (priv->icon_name, frames[0]) != 0)
+        {
+            g_free (priv->icon_name);
+            priv->icon_name = g_strdup (frames[0]);
+
+            queue_property_update (icon, DIRTY_ICON_NAME);
+        }
+    }
+    else
+    {
+        DEBUG ("set_animation: none");
+    }
+
+    queue_property_update (icon, DIRTY_ANIMATION);
+    update_fallback_icon (icon, FALLBACK_IMAGE);
+
+    xapp_status_icon_end_update (icon);
+}
+
+/**
+ * xapp_status_icon_set_icon_pixbuf:
+ * @icon: a #XAppStatusIcon
+ * @pixbuf: (nullable): the image to show, or %NULL to go back to the icon name.
+ *
+ * Sets the icon from image data rather than from an icon name or file, for apps
+ * that render their icon themselves (graphs, badges, etc).
+ *
+ * The pixels are copied into a sealed shared memory buffer, which hosts map
+ * directly, so no image files need to be written or decoded. Hosts that don't
+ * support this will continue to show the icon set with xapp_status_icon_set_icon_name().
+ *
+ * Calling xapp_status_icon_set_icon_name() or xapp_status_icon_set_animation()
+ * replaces the pixbuf.
+ *
+ * Since: 3.4
+ */
+void
+xapp_status_icon_set_icon_pixbuf (XAppStatusIcon *icon,
+                                  GdkPixbuf      *pixbuf)
+{
+    g_return_if_fail (XAPP_IS_STATUS_ICON (icon));
+    g_return_if_fail (GDK_IS_PIXBUF (pixbuf) || pixbuf == NULL);
+    XAppStatusIconPrivate *priv = icon->priv;
+
+    if (pixbuf == NULL && priv->icon_pixbuf == NULL)
+    {
+        return;
+    }
+
+    xapp_status_icon_begin_update (icon);
+
+    if (priv->icon_frames != NULL)
+    {
+        clear_animation (icon);
+        queue_property_update (icon, DIRTY_ANIMATION);
+    }
+
+    clear_icon_pixels (icon);
+
+    if (pixbuf != NULL)
+    {
+        priv->icon_pixbuf = g_object_ref (pixbuf);
+
+#ifdef HAVE_MEMFD_CREATE
+        cairo_surface_t *surface;
+        cairo_t *cr;
+        GError *error = NULL;
+
+        /* Hosts map the pixels as CAIRO_FORMAT_ARGB32, and that's what must be
+         * sent, even for pixbufs without alpha - gdk_cairo_surface_create_from_pixbuf()
+         * would make those RGB24, where the top byte is undefined. */
+        surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                              gdk_pixbuf_get_width (pixbuf),
+                                              gdk_pixbuf_get_height (pixbuf));
+
+        cr = cairo_create (surface);
+        gdk_cairo_set_source_pixbuf (cr, pixbuf, 0, 0);
+        cairo_paint (cr);
+        cairo_destroy (cr);
+
+        priv->pixels_fd = create_pixels_memfd (surface, &error);
+
+        if (priv->pixels_fd >= 0)
+        {
+            priv->pixels_width = cairo_image_surface_get_width (surface);
+            priv->pixels_height = cairo_image_surface_get_height (surface);
+            priv->pixels_stride = cairo_image_surface_get_stride (surface);
+
+            // Never 0, that means there are no pixels.
+            if (++priv->pixels_serial == 0)
+            {
+                priv->pixels_serial = 1;
+            }
+        }
+        else
+        {
+            g_warning ("XAppStatusIcon: %s", error->message);
+            g_error_free (error);
+        }
+
+        cairo_surface_destroy (surface);
+#endif
+
+        DEBUG ("set_icon_pixbuf: %dx%d (serial %u)",
+               gdk_pixbuf_get_width (pixbuf), gdk_pixbuf_get_height (pixbuf), priv->pixels_serial);
+    }
+    else
     {
-        xapp_status_icon_interface_set_icon_name (icon->priv->interface_skeleton, icon_name);
+        DEBUG ("set_icon_pixbuf: none");
     }
 
-    update_fallback_icon (icon);
+    queue_property_update (icon, DIRTY_PIXELS);
+    update_fallback_icon (icon, FALLBACK_IMAGE);
+
+    xapp_status_icon_end_update (icon);
 }
 
 /**
@@ -1971,12 +3287,14 @@ xapp_status_icon_set_tooltip_text (XAppStatusIcon *icon, const gchar *tooltip_te
 
     DEBUG ("set_tooltip_text: %s", tooltip_text);
 
-    if (icon->priv->interface_skeleton)
+    if (!queue_property_update (icon, DIRTY_TOOLTIP_TEXT) &&
+        throttle_property_updates (icon, DIRTY_TOOLTIP_TEXT) != DIRTY_NONE &&
+        icon->priv->interface_skeleton)
     {
         xapp_status_icon_interface_set_tooltip_text (icon->priv->interface_skeleton, tooltip_text);
     }
 
-    update_fallback_icon (icon);
+    update_fallback_icon (icon, FALLBACK_TOOLTIP);
 }
 
 /**
@@ -2003,7 +3321,9 @@ xapp_status_icon_set_label (XAppStatusIcon *icon, const gchar *label)
 
     DEBUG ("set_label: '%s'", label);
 
-    if (icon->priv->interface_skeleton)
+    if (!queue_property_update (icon, DIRTY_LABEL) &&
+        throttle_property_updates (icon, DIRTY_LABEL) != DIRTY_NONE &&
+        icon->priv->interface_skeleton)
     {
         xapp_status_icon_interface_set_label (icon->priv->interface_skeleton, label);
     }
@@ -2032,12 +3352,12 @@ xapp_status_icon_set_visible (XAppStatusIcon *icon, const gboolean visible)
 
     DEBUG ("set_visible: %s", visible ? "TRUE" : "FALSE");
 
-    if (icon->priv->interface_skeleton)
+    if (!queue_property_update (icon, DIRTY_VISIBLE) && icon->priv->interface_skeleton)
     {
         xapp_status_icon_interface_set_visible (icon->priv->interface_skeleton, visible);
     }
 
-    update_fallback_icon (icon);
+    update_fallback_icon (icon, FALLBACK_VISIBLE);
 }
 
 /**
@@ -2286,12 +3606,153 @@ xapp_status_icon_set_metadata (XAppStatusIcon  *icon,
     icon->priv->metadata = g_strdup (metadata);
     g_free (old_meta);
 
-    if (icon->priv->interface_skeleton)
+    if (!queue_property_update (icon, DIRTY_METADATA) && icon->priv->interface_skeleton)
     {
         xapp_status_icon_interface_set_metadata (icon->priv->interface_skeleton, metadata);
     }
 }
 
+/**
+ * xapp_status_icon_begin_update:
+ * @icon: an #XAppStatusIcon
+ *
+ * Starts a batch of property changes. Until the matching call to
+ * xapp_status_icon_end_update(), changes made with the various setters
+ * (icon name, tooltip, label, visibility, metadata) are held back, and
+ * then sent to the applet together as a single update.
+ *
+ * Calls may be nested - the changes are only sent when the outermost
+ * batch is ended.
+ *
+ * Since: 3.4
+ */
+void
+xapp_status_icon_begin_update (XAppStatusIcon *icon)
+{
+    g_return_if_fail (XAPP_IS_STATUS_ICON (icon));
+
+    icon->priv->update_depth++;
+}
+
+/**
+ * xapp_status_icon_end_update:
+ * @icon: an #XAppStatusIcon
+ *
+ * Ends a batch of property changes started with xapp_status_icon_begin_update(),
+ * and sends any changes that were made during it.
+ *
+ * Since: 3.4
+ */
+void
+xapp_status_icon_end_update (XAppStatusIcon *icon)
+{
+    g_return_if_fail (XAPP_IS_STATUS_ICON (icon));
+    g_return_if_fail (icon->priv->update_depth > 0);
+
+    if (--icon->priv->update_depth > 0)
+    {
+        return;
+    }
+
+    flush_property_updates (icon);
+}
+
+/**
+ * xapp_status_icon_set_update_rate_limit:
+ * @icon: an #XAppStatusIcon
+ * @max_per_second: the maximum number of label and tooltip updates to send
+ * each second, or 0 for no limit.
+ *
+ * Limits how often label and tooltip changes are sent to the applet. This is
+ * useful for apps that update these many times a second (network or cpu meters),
+ * as each update wakes up the applet and can cause the panel to relayout.
+ *
+ * Changes made faster than this are combined, and the latest values are always
+ * sent once the limit allows. Other properties, such as visibility, are not affected.
+ *
+ * There is no limit by default.
+ *
+ * Since: 3.4
+ */
+void
+xapp_status_icon_set_update_rate_limit (XAppStatusIcon *icon,
+                                        guint           max_per_second)
+{
+    g_return_if_fail (XAPP_IS_STATUS_ICON (icon));
+
+    DEBUG ("set_update_rate_limit: %u", max_per_second);
+
+    icon->priv->rate_limit = max_per_second;
+
+    // Anything waiting was held back using the old limit, so send it now.
+    if (icon->priv->throttle_id > 0)
+    {
+        g_source_remove (icon->priv->throttle_id);
+        on_throttle_timeout (icon);
+    }
+}
+
+/**
+ * xapp_status_icon_set_scroll_coalescing:
+ * @icon: an #XAppStatusIcon
+ * @coalescing: whether to combine scrolls
+ *
+ * Sets #XAppStatusIcon:scroll-coalescing. Only turn this on if your
+ * #XAppStatusIcon::scroll-event handler uses the amount it's given, rather than
+ * treating each event as a single step.
+ *
+ * Since: 3.4
+ */
+void
+xapp_status_icon_set_scroll_coalescing (XAppStatusIcon *icon,
+                                        gboolean        coalescing)
+{
+    g_return_if_fail (XAPP_IS_STATUS_ICON (icon));
+
+    coalescing = !!coalescing;
+
+    if (coalescing == icon->priv->scroll_coalescing)
+    {
+        return;
+    }
+
+    DEBUG ("set_scroll_coalescing: %s", coalescing ? "TRUE" : "FALSE");
+
+    icon->priv->scroll_coalescing = coalescing;
+
+    // Don't hold on to anything that's waiting to be combined.
+    if (icon->priv->scroll_idle_id > 0)
+    {
+        g_source_remove (icon->priv->scroll_idle_id);
+        flush_scroll (icon);
+    }
+
+    if (icon->priv->interface_skeleton)
+    {
+        xapp_status_icon_interface_set_supports_scroll_coalescing (icon->priv->interface_skeleton, coalescing);
+    }
+
+    g_object_notify (G_OBJECT (icon), "scroll-coalescing");
+}
+
+/**
+ * xapp_status_icon_get_scroll_coalescing:
+ * @icon: an #XAppStatusIcon
+ *
+ * Returns whether scrolls are combined (see #XAppStatusIcon:scroll-coalescing).
+ *
+ * Returns: %TRUE if scrolls are combined.
+ *
+ * Since: 3.4
+ */
+gboolean
+xapp_status_icon_get_scroll_coalescing (XAppStatusIcon *icon)
+{
+    g_return_val_if_fail (XAPP_IS_STATUS_ICON (icon), FALSE);
+
+    return icon->priv->scroll_coalescing;
+}
+
 /**
  * xapp_status_icon_any_monitors:
  *
@@ -2308,6 +3769,13 @@ xapp_status_icon_any_monitors (void)
     GError *error;
     gboolean found;
 
+    if (applet_watcher != NULL && applet_watcher->have_monitor_list)
+    {
+        DEBUG ("Monitors found (cached): %s", applet_watcher->have_monitors ? "TRUE" : "FALSE");
+
+        return applet_watcher->have_monitors;
+    }
+
     DEBUG("Looking for status monitors");
 
     error = NULL;
@@ -2369,3 +3837,161 @@ xapp_status_icon_any_monitors (void)
     return found;
 }
 
+static void
+on_any_monitors_bus_ready (GObject      *source,
+                           GAsyncResult *res,
+                           gpointer      user_data)
+{
+    GTask *task = G_TASK (user_data);
+    GDBusConnection *connection;
+    GError *error;
+
+    error = NULL;
+
+    connection = g_bus_get_finish (res, &error);
+
+    if (connection == NULL)
+    {
+        g_task_return_error (task, error);
+        g_object_unref (task);
+        return;
+    }
+
+    applet_watcher_ensure (connection);
+    g_object_unref (connection);
+
+    applet_watcher_query (task);
+}
+
+/**
+ * xapp_status_icon_any_monitors_async:
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ * @callback: the #GAsyncReadyCallback to call when the answer is known
+ * @user_data: data to pass to @callback
+ *
+ * Looks for the existence of any active #XAppStatusIconMonitors on the bus,
+ * without blocking. Call xapp_status_icon_any_monitors_finish() from @callback
+ * to get the result.
+ *
+ * The answer is cached and kept current for the lifetime of the process, so later
+ * calls (including to xapp_status_icon_any_monitors()) return right away, without
+ * going to the bus. Connect to #XAppStatusIcon::monitors-changed to be told when
+ * it changes, or use xapp_status_icon_watch_monitors() if you don't have an icon.
+ *
+ * Since: 3.4
+ */
+void
+xapp_status_icon_any_monitors_async (GCancellable        *cancellable,
+                                     GAsyncReadyCallback  callback,
+                                     gpointer             user_data)
+{
+    GTask *task;
+
+    task = g_task_new (NULL, cancellable, callback, user_data);
+    g_task_set_source_tag (task, xapp_status_icon_any_monitors_async);
+
+    if (applet_watcher != NULL)
+    {
+        applet_watcher_query (task);
+        return;
+    }
+
+    g_bus_get (G_BUS_TYPE_SESSION,
+               cancellable,
+               on_any_monitors_bus_ready,
+               task);
+}
+
+/**
+ * xapp_status_icon_any_monitors_finish:
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with xapp_status_icon_any_monitors_async().
+ *
+ * Returns: %TRUE if at least one monitor was found, %FALSE if none were,
+ * or if there was an error.
+ *
+ * Since: 3.4
+ */
+gboolean
+xapp_status_icon_any_monitors_finish (GAsyncResult  *result,
+                                      GError       **error)
+{
+    g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+
+    return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/**
+ * xapp_status_icon_watch_monitors:
+ * @callback: the #XAppStatusIconMonitorsCallback to call when monitors come or go
+ * @user_data: data to pass to @callback
+ * @notify: (nullable): a #GDestroyNotify for @user_data, or %NULL
+ *
+ * Calls @callback whenever the first #XAppStatusIconMonitor appears on the bus,
+ * or the last one disappears, for the lifetime of the process or until
+ * xapp_status_icon_unwatch_monitors() is called. It isn't called for the
+ * initial state - use xapp_status_icon_any_monitors_async() for that.
+ *
+ * This is the same as #XAppStatusIcon::monitors-changed, for code that doesn't
+ * have an #XAppStatusIcon of its own.
+ *
+ * Returns: an id to pass to xapp_status_icon_unwatch_monitors().
+ *
+ * Since: 3.4
+ */
+guint
+xapp_status_icon_watch_monitors (XAppStatusIconMonitorsCallback callback,
+                                 gpointer                       user_data,
+                                 GDestroyNotify                 notify)
+{
+    MonitorsWatch *watch;
+
+    g_return_val_if_fail (callback != NULL, 0);
+
+    watch = g_slice_new0 (MonitorsWatch);
+    watch->id = next_monitors_watch_id++;
+    watch->callback = callback;
+    watch->user_data = user_data;
+    watch->notify = notify;
+
+    monitors_watches = g_list_append (monitors_watches, watch);
+
+    // This keeps the watcher (and the answer) around from now on.
+    xapp_status_icon_any_monitors_async (NULL, NULL, NULL);
+
+    return watch->id;
+}
+
+/**
+ * xapp_status_icon_unwatch_monitors:
+ * @watch_id: an id returned by xapp_status_icon_watch_monitors()
+ *
+ * Stops calling a callback added with xapp_status_icon_watch_monitors(), and
+ * frees its data.
+ *
+ * Since: 3.4
+ */
+void
+xapp_status_icon_unwatch_monitors (guint watch_id)
+{
+    MonitorsWatch *watch;
+
+    watch = find_monitors_watch (watch_id);
+
+    if (watch == NULL)
+    {
+        g_warning ("Invalid id %u passed to xapp_status_icon_unwatch_monitors()", watch_id);
+        return;
+    }
+
+    monitors_watches = g_list_remove (monitors_watches, watch);
+
+    if (watch->notify != NULL)
+    {
+        watch->notify (watch->user_data);
+    }
+
+    g_slice_free (MonitorsWatch, watch);
+}
@@ -45,11 +45,26 @@ typedef enum
   XAPP_SCROLL_RIGHT
 } XAppScrollDirection;
 
+/**
+ * XAppStatusIconMonitorsCallback:
+ * @have_monitors: whether there are any #XAppStatusIconMonitors on the bus now
+ * @user_data: Callback data
+ *
+ * Callback for xapp_status_icon_watch_monitors(), when the first
+ * #XAppStatusIconMonitor appears on the bus, or the last one disappears.
+ */
+typedef void (* XAppStatusIconMonitorsCallback) (gboolean have_monitors,
+                                                 gpointer user_data);
 
 XAppStatusIcon *xapp_status_icon_new                (void);
 XAppStatusIcon *xapp_status_icon_new_with_name      (const gchar *name);
 void            xapp_status_icon_set_name           (XAppStatusIcon *icon, const gchar *name);
 void            xapp_status_icon_set_icon_name      (XAppStatusIcon *icon, const gchar *icon_name);
+void            xapp_status_icon_set_animation      (XAppStatusIcon      *icon,
+                                                     const gchar * const *frames,
+                                                     guint                interval_ms);
+void            xapp_status_icon_set_icon_pixbuf    (XAppStatusIcon *icon,
+                                                     GdkPixbuf      *pixbuf);
 gint            xapp_status_icon_get_icon_size      (XAppStatusIcon *icon);
 void            xapp_status_icon_set_tooltip_text   (XAppStatusIcon *icon, const gchar *tooltip_text);
 void            xapp_status_icon_set_label          (XAppStatusIcon *icon, const gchar *label);
@@ -69,9 +84,25 @@ GtkWidget      *xapp_status_icon_get_secondary_menu (XAppStatusIcon *icon);
 XAppStatusIconState xapp_status_icon_get_state      (XAppStatusIcon *icon);
 void            xapp_status_icon_set_metadata       (XAppStatusIcon *icon,
                                                      const gchar    *metadata);
+void            xapp_status_icon_begin_update       (XAppStatusIcon *icon);
+void            xapp_status_icon_end_update         (XAppStatusIcon *icon);
+void            xapp_status_icon_set_update_rate_limit (XAppStatusIcon *icon,
+                                                        guint           max_per_second);
+void            xapp_status_icon_set_scroll_coalescing (XAppStatusIcon *icon,
+                                                        gboolean        coalescing);
+gboolean        xapp_status_icon_get_scroll_coalescing (XAppStatusIcon *icon);
 
 /* static */
 gboolean        xapp_status_icon_any_monitors       (void);
+void            xapp_status_icon_any_monitors_async  (GCancellable        *cancellable,
+                                                      GAsyncReadyCallback  callback,
+                                                      gpointer             user_data);
+gboolean        xapp_status_icon_any_monitors_finish (GAsyncResult        *result,
+                                                      GError             **error);
+guint           xapp_status_icon_watch_monitors      (XAppStatusIconMonitorsCallback  callback,
+                                                      gpointer                        user_data,
+                                                      GDestroyNotify                  notify);
+void            xapp_status_icon_unwatch_monitors    (guint                           watch_id);
 G_END_DECLS
 
 #endif  /* __XAPP_STATUS_ICON_H__ */
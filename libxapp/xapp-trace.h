@@ -0,0 +1,52 @@
+#ifndef __XAPP_TRACE_H__
+#define __XAPP_TRACE_H__
+
+#include <config.h>
+#include <glib.h>
+
+#ifdef HAVE_SYSPROF
+#include <sysprof-capture.h>
+#endif
+
+G_BEGIN_DECLS
+
+/* Timestamped trace points, used along the status icon click-to-menu path and
+ * for icon discovery in the monitor.
+ *
+ * With sysprof support (-Dsysprof=enabled), each one is recorded as a mark in
+ * the "XApp" group while a capture is running. Otherwise they go to the debug
+ * log along with their duration, when XAPP_DEBUG includes the including file's
+ * DEBUG_FLAG.
+ *
+ * Times are nanoseconds on the monotonic clock. @begin is the start of the
+ * span being marked - pass XAPP_TRACE_CURRENT_TIME for a point event. */
+
+#ifdef HAVE_SYSPROF
+
+#define XAPP_TRACE_CURRENT_TIME SYSPROF_CAPTURE_CURRENT_TIME
+
+#define XAPP_TRACE_MARK(begin, name, format, ...) \
+  sysprof_collector_mark_printf ((begin), SYSPROF_CAPTURE_CURRENT_TIME - (begin), \
+                                 "XApp", (name), format, ##__VA_ARGS__)
+
+#else /* HAVE_SYSPROF */
+
+#define XAPP_TRACE_CURRENT_TIME (g_get_monotonic_time () * 1000)
+
+#ifdef ENABLE_DEBUG
+
+#define XAPP_TRACE_MARK(begin, name, format, ...) \
+  DEBUG ("trace: %s (%" G_GINT64_FORMAT " us): " format, (name), \
+         (XAPP_TRACE_CURRENT_TIME - (begin)) / 1000, ##__VA_ARGS__)
+
+#else /* ENABLE_DEBUG */
+
+#define XAPP_TRACE_MARK(begin, name, format, ...) \
+  G_STMT_START { (void) (begin); } G_STMT_END
+
+#endif /* ENABLE_DEBUG */
+#endif /* HAVE_SYSPROF */
+
+G_END_DECLS
+
+#endif /* __XAPP_TRACE_H__ */
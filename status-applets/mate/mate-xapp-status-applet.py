@@ -3,14 +3,17 @@
 import locale
 import gettext
 import json
+import mmap
 import os
 import sys
 import setproctitle
 
+import cairo
 import gi
 gi.require_version("Gtk", "3.0")
 gi.require_version("XApp", "1.0")
 gi.require_version('MatePanelApplet', '4.0')
+gi.require_foreign("cairo")
 from gi.repository import Gtk, GdkPixbuf, Gdk, GObject, Gio, XApp, GLib, MatePanelApplet
 
 import applet_constants
@@ -68,16 +71,7 @@ class StatusWidget(Gtk.ToggleButton):
         self.symbolic_icon_offset = symbolic_icon_offset
         self.color_icon_offset = color_icon_offset
 
-        self.proxy = icon
-        self.proxy.props.icon_size = DEFAULT_ICON_SIZE
-
-        # this is the bus owned name
-        self.name = self.proxy.get_name()
-
-        self.add_events(Gdk.EventMask.SCROLL_MASK)
-
-        # this is (usually) the name of the remote process
-        self.proc_name = self.proxy.props.name
+        self.add_events(Gdk.EventMask.SCROLL_MASK | Gdk.EventMask.SMOOTH_SCROLL_MASK)
 
         self.box = Gtk.Box(orientation=Gtk.Orientation.HORIZONTAL)
 
@@ -94,27 +88,17 @@ class StatusWidget(Gtk.ToggleButton):
 
         self.show_all()
 
-        flags = GObject.BindingFlags.DEFAULT | GObject.BindingFlags.SYNC_CREATE
-
-        self.proxy.bind_property("label", self.label, "label", flags)
-        self.proxy.bind_property("tooltip-text", self, "tooltip-markup", flags)
-        self.proxy.bind_property("visible", self, "visible", flags)
-
-        self.proxy.connect("notify::primary-menu-is-open", self.menu_state_changed)
-        self.proxy.connect("notify::secondary-menu-is-open", self.menu_state_changed)
-
-        self.highlight_both_menus = False
+        self.proxy = None
+        self.bindings = []
+        self.proxy_handlers = []
+        self.bind_proxy(icon)
 
-        if self.proxy.props.metadata not in ("", None):
-            try:
-                meta = json.loads(self.proxy.props.metadata)
-                if meta["highlight-both-menus"]:
-                    self.highlight_both_menus = True
-            except json.JSONDecodeError as e:
-                print("Could not read metadata: %s" % e)
+        self.animation_surfaces = []
+        self.animation_index = 0
+        self.animation_id = 0
 
-        self.proxy.connect("notify::icon-name", self._on_icon_name_changed)
-        self.proxy.connect("notify::name", self._on_name_changed)
+        self.pixels_map = None
+        self.pixels_surface = None
 
         self.in_widget = False
         self.plain_surface = None
@@ -122,6 +106,16 @@ class StatusWidget(Gtk.ToggleButton):
 
         self.menu_opened = False
 
+        # For icons that take a whole click at once, the press waiting for its release.
+        self.press_button = 0
+        self.press_time = 0
+
+        # Scrolling not yet sent, in steps - it's sent at most once per frame.
+        self.scroll_dx = 0.0
+        self.scroll_dy = 0.0
+        self.scroll_time = 0
+        self.scroll_tick_id = 0
+
         self.connect("button-press-event", self.on_button_press)
         self.connect("button-release-event", self.on_button_release)
         self.connect("scroll-event", self.on_scroll)
@@ -130,10 +124,84 @@ class StatusWidget(Gtk.ToggleButton):
 
         self.update_orientation()
         self.update_icon(size)
+        self.update_pixels()
+
+    def bind_proxy(self, proxy):
+        self.proxy = proxy
+        self.proxy.props.icon_size = self.icon_size - self.symbolic_icon_offset
+
+        # this is the bus owned name
+        self.name = self.proxy.get_name()
+
+        # this is (usually) the name of the remote process
+        self.proc_name = self.proxy.props.name
+
+        flags = GObject.BindingFlags.DEFAULT | GObject.BindingFlags.SYNC_CREATE
+
+        self.bindings = [
+            self.proxy.bind_property("label", self.label, "label", flags),
+            self.proxy.bind_property("tooltip-text", self, "tooltip-markup", flags),
+            self.proxy.bind_property("visible", self, "visible", flags)
+        ]
+
+        self.proxy_handlers = [
+            self.proxy.connect("notify::primary-menu-is-open", self.menu_state_changed),
+            self.proxy.connect("notify::secondary-menu-is-open", self.menu_state_changed),
+            self.proxy.connect("notify::icon-name", self._on_icon_name_changed),
+            self.proxy.connect("notify::icon-frames", self._on_animation_changed),
+            self.proxy.connect("notify::frame-interval", self._on_animation_changed),
+            self.proxy.connect("notify::icon-pixels-serial", self._on_icon_pixels_changed),
+            self.proxy.connect("notify::name", self._on_name_changed)
+        ]
+
+        self.highlight_both_menus = False
+
+        if self.proxy.props.metadata not in ("", None):
+            try:
+                meta = json.loads(self.proxy.props.metadata)
+                if meta["highlight-both-menus"]:
+                    self.highlight_both_menus = True
+            except json.JSONDecodeError as e:
+                print("Could not read metadata: %s" % e)
+
+    def unbind_proxy(self):
+        for binding in self.bindings:
+            binding.unbind()
+
+        for handler in self.proxy_handlers:
+            self.proxy.disconnect(handler)
+
+        self.bindings = []
+        self.proxy_handlers = []
+
+    def replace_proxy(self, proxy):
+        # The app restarted - keep this widget, and show the new instance's icon in it.
+        self.stop_animation()
+        self.clear_pixels()
+        self.unbind_proxy()
+
+        self.bind_proxy(proxy)
+
+        self.menu_opened = False
+        self.press_button = 0
+        self.set_active(False)
+
+        self.update_icon()
+        self.update_pixels()
 
     def _on_icon_name_changed(self, proxy, gparamspec, data=None):
+        # When animating or showing pixels, the icon name is only for hosts that can't.
+        if self.animation_id > 0 or self.pixels_surface is not None:
+            return
+
         self.update_icon()
 
+    def _on_animation_changed(self, proxy, gparamspec, data=None):
+        self.update_animation()
+
+    def _on_icon_pixels_changed(self, proxy, gparamspec, data=None):
+        self.update_pixels()
+
     def _on_name_changed(self, proxy, gparamspec, data=None):
         self.emit("re-sort")
 
@@ -150,10 +218,154 @@ class StatusWidget(Gtk.ToggleButton):
             self.icon_size = new_size
 
         self.proxy.props.icon_size = self.icon_size - self.symbolic_icon_offset
+
+        if self.pixels_surface is not None:
+            self.show_pixels()
+            return
+
+        if len(self.proxy.props.icon_frames or []) > 1:
+            self.update_animation()
+            return
+
         string = self.proxy.props.icon_name
 
         self.set_icon(string)
 
+    def clear_pixels(self):
+        if self.pixels_surface is not None:
+            self.pixels_surface.finish()
+            self.pixels_surface = None
+
+        if self.pixels_map is not None:
+            self.pixels_map.close()
+            self.pixels_map = None
+
+    def update_pixels(self):
+        serial = self.proxy.props.icon_pixels_serial
+
+        if serial == 0:
+            if self.pixels_surface is not None:
+                self.clear_pixels()
+                self.update_icon()
+            return
+
+        self.proxy.call_get_icon_pixels(None, None, self.on_get_icon_pixels_finished, serial)
+
+    def on_get_icon_pixels_finished(self, proxy, res, serial):
+        try:
+            ok, handle, width, height, stride, fd_list = proxy.call_get_icon_pixels_finish(res)
+        except GLib.Error as e:
+            print("MateXAppStatusApplet: Could not get icon pixels for '%s': %s" % (self.proc_name, e.message))
+            return
+
+        fd = fd_list.get(handle)
+
+        # A newer image was set while this one was on its way.
+        if serial != self.proxy.props.icon_pixels_serial:
+            os.close(fd)
+            return
+
+        self.clear_pixels()
+        self.stop_animation()
+
+        try:
+            # The buffer is sealed, so map it privately - cairo wants a writable buffer,
+            # but nothing is ever written to it.
+            self.pixels_map = mmap.mmap(fd, stride * height,
+                                        flags=mmap.MAP_PRIVATE,
+                                        prot=mmap.PROT_READ | mmap.PROT_WRITE)
+            self.pixels_surface = cairo.ImageSurface.create_for_data(self.pixels_map,
+                                                                     cairo.FORMAT_ARGB32,
+                                                                     width, height, stride)
+        except (OSError, ValueError, cairo.Error) as e:
+            print("MateXAppStatusApplet: Could not map icon pixels for '%s': %s" % (self.proc_name, str(e)))
+            self.clear_pixels()
+            self.update_icon()
+            return
+        finally:
+            os.close(fd)
+
+        self.show_pixels()
+
+    def show_pixels(self):
+        size = self.icon_size - self.color_icon_offset
+        scale = self.get_scale_factor()
+
+        width = self.pixels_surface.get_width()
+        height = self.pixels_surface.get_height()
+        factor = min(size / width, size / height)
+
+        surface = cairo.ImageSurface(cairo.FORMAT_ARGB32, size * scale, size * scale)
+        surface.set_device_scale(scale, scale)
+
+        cr = cairo.Context(surface)
+        cr.translate((size - (width * factor)) / 2, (size - (height * factor)) / 2)
+        cr.scale(factor, factor)
+        cr.set_source_surface(self.pixels_surface, 0, 0)
+        cr.paint()
+
+        self.image.set_from_surface(surface)
+
+    def stop_animation(self):
+        if self.animation_id > 0:
+            GLib.source_remove(self.animation_id)
+            self.animation_id = 0
+
+        self.animation_surfaces = []
+        self.animation_index = 0
+
+    def update_animation(self):
+        self.stop_animation()
+
+        frames = self.proxy.props.icon_frames or []
+        interval = self.proxy.props.frame_interval
+
+        if len(frames) < 2 or interval == 0:
+            if self.pixels_surface is None:
+                self.set_icon(self.proxy.props.icon_name)
+            return
+
+        # Load every frame once up front, so each tick is only a surface swap.
+        scale = self.get_scale_factor()
+
+        for frame in frames:
+            surface = None
+
+            try:
+                if os.path.exists(frame):
+                    icon = Gio.FileIcon.new(Gio.File.new_for_path(frame))
+                else:
+                    icon = Gio.ThemedIcon.new(frame)
+
+                info = self.theme.lookup_by_gicon_for_scale(icon,
+                                                            self.get_pixel_size(frame),
+                                                            scale,
+                                                            Gtk.IconLookupFlags.FORCE_SIZE)
+                if info:
+                    surface = info.load_surface(None)
+            except GLib.Error as e:
+                print("MateXAppStatusApplet: Could not load animation frame '%s' for '%s': %s" % (frame, self.proc_name, e.message))
+
+            self.animation_surfaces.append(surface)
+
+        self.show_animation_frame()
+        self.animation_id = GLib.timeout_add(interval, self.on_animation_tick)
+
+    def show_animation_frame(self):
+        surface = self.animation_surfaces[self.animation_index]
+
+        if surface is not None:
+            self.image.set_from_surface(surface)
+        else:
+            self.image.set_pixel_size(self.icon_size - self.symbolic_icon_offset)
+            self.image.set_from_icon_name("image-missing", Gtk.IconSize.MENU)
+
+    def on_animation_tick(self):
+        self.animation_index = (self.animation_index + 1) % len(self.animation_surfaces)
+        self.show_animation_frame()
+
+        return GLib.SOURCE_CONTINUE
+
     def update_style(self, orientation):
         ctx = self.get_style_context()
 
@@ -180,16 +392,17 @@ class StatusWidget(Gtk.ToggleButton):
             self.label.set_visible(False)
             self.label.set_margin_start(0)
 
+    def get_pixel_size(self, string):
+        if "symbolic" in string:
+            return self.icon_size - self.symbolic_icon_offset
+        else:
+            return self.icon_size - self.color_icon_offset
+
     def set_icon(self, string):
         fallback = True
 
         if string:
-            if "symbolic" in string:
-                size = self.icon_size - self.symbolic_icon_offset
-            else:
-                size = self.icon_size - self.color_icon_offset
-
-            self.image.set_pixel_size(size)
+            self.image.set_pixel_size(self.get_pixel_size(string))
 
             try:
                 if os.path.exists(string):
@@ -244,6 +457,11 @@ class StatusWidget(Gtk.ToggleButton):
         if event.state & Gdk.ModifierType.CONTROL_MASK and event.button == Gdk.BUTTON_SECONDARY:
            return Gdk.EVENT_PROPAGATE
 
+        if self.proxy.props.supports_click:
+            self.press_button = event.button
+            self.press_time = event.time
+            return Gdk.EVENT_STOP
+
         orientation = translate_applet_orientation_to_xapp(self.orientation)
 
         x, y = self.calc_menu_origin(widget, orientation)
@@ -265,6 +483,15 @@ class StatusWidget(Gtk.ToggleButton):
             self.menu_opened = True
 
         x, y = self.calc_menu_origin(widget, orientation)
+
+        if self.proxy.props.supports_click:
+            # No press, no click - the icon would have ignored this release too.
+            if self.press_button == event.button:
+                self.proxy.call_click(x, y, event.button, self.press_time, event.time, orientation, None, None)
+
+            self.press_button = 0
+            return Gdk.EVENT_PROPAGATE
+
         self.proxy.call_button_release(x, y, event.button, event.time, orientation, None, None)
 
         return Gdk.EVENT_PROPAGATE
@@ -272,22 +499,50 @@ class StatusWidget(Gtk.ToggleButton):
     def on_scroll(self, widget, event):
         has, direction = event.get_scroll_direction()
 
-        x_dir = XApp.ScrollDirection.UP
-        delta = 0
+        if not has:
+            has, dx, dy = event.get_scroll_deltas()
+            if has:
+                self.scroll_dx += dx
+                self.scroll_dy += dy
+        elif direction == Gdk.ScrollDirection.UP:
+            self.scroll_dy -= 1
+        elif direction == Gdk.ScrollDirection.DOWN:
+            self.scroll_dy += 1
+        elif direction == Gdk.ScrollDirection.LEFT:
+            self.scroll_dx -= 1
+        elif direction == Gdk.ScrollDirection.RIGHT:
+            self.scroll_dx += 1
+
+        self.scroll_time = event.time
+
+        if self.scroll_tick_id == 0:
+            self.scroll_tick_id = self.add_tick_callback(self.flush_scroll)
+
+        return Gdk.EVENT_STOP
+
+    def flush_scroll(self, widget, frame_clock):
+        self.scroll_tick_id = 0
 
-        if direction != Gdk.ScrollDirection.SMOOTH:
-            x_dir = XApp.ScrollDirection(int(direction))
+        self.scroll_dy = self.send_scroll_steps(self.scroll_dy, XApp.ScrollDirection.UP, XApp.ScrollDirection.DOWN)
+        self.scroll_dx = self.send_scroll_steps(self.scroll_dx, XApp.ScrollDirection.LEFT, XApp.ScrollDirection.RIGHT)
 
-            if direction == Gdk.ScrollDirection.UP:
-                delta = -1
-            elif direction == Gdk.ScrollDirection.DOWN:
-                delta = 1
-            elif direction == Gdk.ScrollDirection.LEFT:
-                delta = -1
-            elif direction == Gdk.ScrollDirection.RIGHT:
-                delta = 1
+        return GLib.SOURCE_REMOVE
+
+    def send_scroll_steps(self, pending, negative, positive):
+        # Partial steps from smooth scrolling wait for the rest.
+        steps = int(pending)
+
+        if steps != 0:
+            direction = negative if steps < 0 else positive
+
+            if self.proxy.props.supports_scroll_coalescing:
+                self.proxy.call_scroll(steps, direction, self.scroll_time, None, None)
+            else:
+                # Other apps expect one step at a time.
+                for i in range(abs(steps)):
+                    self.proxy.call_scroll(-1 if steps < 0 else 1, direction, self.scroll_time, None, None)
 
-        self.proxy.call_scroll_sync(delta, x_dir, event.time, None)
+        return pending - steps
 
     def calc_menu_origin(self, widget, orientation):
         alloc = widget.get_allocation()
@@ -390,6 +645,7 @@ class MateXAppStatusApplet(object):
         self.monitor = XApp.StatusIconMonitor()
         self.monitor.connect("icon-added", self.on_icon_added)
         self.monitor.connect("icon-removed", self.on_icon_removed)
+        self.monitor.connect("icon-replaced", self.on_icon_replaced)
 
     def make_key(self, proxy):
         name = proxy.get_name()
@@ -400,6 +656,8 @@ class MateXAppStatusApplet(object):
 
     def destroy_monitor (self):
         for key in self.indicators.keys():
+            self.indicators[key].stop_animation()
+            self.indicators[key].clear_pixels()
             self.indicator_box.remove(self.indicators[key])
 
         self.monitor = None
@@ -426,12 +684,28 @@ class MateXAppStatusApplet(object):
     def on_icon_removed(self, monitor, proxy):
         key = self.make_key(proxy)
 
+        self.indicators[key].stop_animation()
+        self.indicators[key].clear_pixels()
         self.indicator_box.remove(self.indicators[key])
         self.indicators[key].disconnect_by_func(self.sort_icons)
         del(self.indicators[key])
 
         self.sort_icons()
 
+    def on_icon_replaced(self, monitor, old_proxy, new_proxy):
+        old_key = self.make_key(old_proxy)
+
+        if old_key not in self.indicators:
+            self.on_icon_added(monitor, new_proxy)
+            return
+
+        indicator = self.indicators.pop(old_key)
+        self.indicators[self.make_key(new_proxy)] = indicator
+
+        indicator.replace_proxy(new_proxy)
+
+        self.sort_icons()
+
     def update_orientation(self):
         self.on_applet_orientation_changed(self, self.applet.get_orient())
 
@@ -0,0 +1,100 @@
+"""
+Shared harness for the xapp-status-icon-* benchmark scripts.
+
+Each script plays both sides: run normally, it starts a private session bus and
+runs copies of itself on it with --provider, as the app (or apps) under test.
+Its docstring - a one line summary, a blank line, then what it does and what it
+reports - is used for its --help.
+
+Times are collected in microseconds (GLib.get_monotonic_time()) and reported in
+milliseconds.
+"""
+
+import gi
+gi.require_version('Gtk', '3.0')
+gi.require_version('XApp', '1.0')
+from gi.repository import Gio, GLib
+import argparse
+import os
+import subprocess
+import sys
+
+def make_parser(doc):
+    summary, _, details = doc.strip().partition("\n\n")
+
+    parser = argparse.ArgumentParser(description=summary,
+                                     epilog=details,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--provider", action="store_true", help=argparse.SUPPRESS)
+
+    return parser
+
+def run(parser, provider_class, benchmark_class, provider_main=None):
+    args = parser.parse_args()
+
+    if args.provider:
+        # Keep it referenced while the loop runs.
+        provider = provider_class(args)
+
+        if provider_main is None:
+            GLib.MainLoop().run()
+        else:
+            provider_main()
+    else:
+        benchmark_class(args).run()
+
+    sys.exit(0)
+
+def summarize(samples):
+    if not samples:
+        return "no samples"
+
+    samples = sorted(samples)
+    n = len(samples)
+
+    def percentile(p):
+        return samples[min(n - 1, int(n * p / 100))] / 1000.0
+
+    return "n: %d  min: %.2f  p50: %.2f  p99: %.2f  max: %.2f  mean: %.2f" % \
+        (n, samples[0] / 1000.0, percentile(50), percentile(99), samples[-1] / 1000.0,
+         sum(samples) / n / 1000.0)
+
+def print_samples(title, samples):
+    print("%s (ms):" % title)
+    print("  " + summarize(samples))
+
+class PrivateBus():
+    """
+    A private session bus, and the providers running on it. Everything in this
+    process (an XAppStatusIconMonitor included) uses it from here on.
+    """
+    def __init__(self):
+        self.bus = Gio.TestDBus.new(Gio.TestDBusFlags.NONE)
+        self.bus.up()
+
+        self.address = self.bus.get_bus_address()
+        self.env = dict(os.environ, DBUS_SESSION_BUS_ADDRESS=self.address)
+        self.providers = []
+
+    def new_connection(self):
+        return Gio.DBusConnection.new_for_address_sync(self.address,
+                                                       Gio.DBusConnectionFlags.AUTHENTICATION_CLIENT |
+                                                       Gio.DBusConnectionFlags.MESSAGE_BUS_CONNECTION,
+                                                       None, None)
+
+    def spawn_provider(self, *args):
+        cmd = [sys.argv[0], "--provider"] + [str(arg) for arg in args]
+
+        provider = subprocess.Popen(cmd, env=self.env)
+        self.providers.append(provider)
+
+        return provider
+
+    def down(self):
+        for provider in self.providers:
+            if provider.poll() is None:
+                provider.terminate()
+                provider.wait()
+
+        self.providers = []
+        self.bus.down()
@@ -28,6 +28,7 @@ struct _XAppSnWatcher
 
     guint owner_id;
     guint name_listener_id;
+    guint monitors_watch_id;
 
     GHashTable *items;
 
@@ -53,11 +54,12 @@ static void continue_startup (XAppSnWatcher *watcher);
 static void update_published_items (XAppSnWatcher *watcher);
 
 static void
-handle_status_applet_name_owner_appeared (XAppSnWatcher *watcher,
-                                          const gchar   *name,
-                                          const gchar   *new_owner)
+on_monitors_changed (gboolean have_monitors,
+                     gpointer user_data)
 {
-    if (g_str_has_prefix (name, STATUS_ICON_MONITOR_PREFIX))
+    XAppSnWatcher *watcher = XAPP_SN_WATCHER (user_data);
+
+    if (have_monitors)
     {
         if (watcher->shutdown_pending)
         {
@@ -80,6 +82,20 @@ handle_status_applet_name_owner_appeared (XAppSnWatcher *watcher,
             }
         }
     }
+    else
+    {
+        DEBUG ("Lost our last monitor, starting countdown\n");
+
+        if (!watcher->shutdown_pending)
+        {
+            watcher->shutdown_pending = TRUE;
+            g_application_release (G_APPLICATION (watcher));
+
+            sn_watcher_interface_set_is_status_notifier_host_registered (watcher->skeleton,
+                                                                         FALSE);
+            g_dbus_interface_skeleton_flush (G_DBUS_INTERFACE_SKELETON (watcher->skeleton));
+        }
+    }
 }
 
 static void
@@ -108,42 +124,6 @@ handle_sn_item_name_owner_lost (XAppSnWatcher *watcher,
     g_list_free (keys);
 }
 
-static void
-handle_status_applet_name_owner_lost (XAppSnWatcher *watcher,
-                                      const gchar   *name,
-                                      const gchar   *old_owner)
-{
-    if (g_str_has_prefix (name, STATUS_ICON_MONITOR_PREFIX))
-    {
-        DEBUG ("Lost a monitor, checking for any more");
-
-        if (xapp_status_icon_any_monitors ())
-        {
-            DEBUG ("Still have a monitor, continuing");
-
-            return;
-        }
-        else
-        {
-            DEBUG ("Lost our last monitor, starting countdown\n");
-
-            if (!watcher->shutdown_pending)
-            {
-                watcher->shutdown_pending = TRUE;
-                g_application_release (G_APPLICATION (watcher));
-
-                sn_watcher_interface_set_is_status_notifier_host_registered (watcher->skeleton,
-                                                                             FALSE);
-                g_dbus_interface_skeleton_flush (G_DBUS_INTERFACE_SKELETON (watcher->skeleton));
-            }
-        }
-    }
-    else
-    {
-        handle_sn_item_name_owner_lost (watcher, name, old_owner);
-    }
-}
-
 static void
 name_owner_changed_signal (GDBusConnection *connection,
                            const gchar     *sender_name,
@@ -166,13 +146,10 @@ name_owner_changed_signal (GDBusConnection *connection,
         return;
     }
 
-    if (g_strcmp0 (new_owner, "") == 0)
+    /* Monitors coming and going are followed by libxapp (see on_monitors_changed) */
+    if (g_strcmp0 (new_owner, "") == 0 && !g_str_has_prefix (name, STATUS_ICON_MONITOR_PREFIX))
     {
-        handle_status_applet_name_owner_lost (watcher, name, old_owner);
-    }
-    else
-    {
-        handle_status_applet_name_owner_appeared (watcher, name, new_owner);
+        handle_sn_item_name_owner_lost (watcher, name, old_owner);
     }
 }
 
@@ -547,6 +524,33 @@ clean_tempfiles (XAppSnWatcher *watcher)
     g_free (cmd);
 }
 
+static void
+on_startup_monitors_checked (GObject      *source,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+    XAppSnWatcher *watcher = XAPP_SN_WATCHER (user_data);
+    GError *error = NULL;
+
+    if (xapp_status_icon_any_monitors_finish (res, &error))
+    {
+        continue_startup (watcher);
+    }
+    else
+    {
+        if (error != NULL)
+        {
+            g_warning ("Unable to check for monitors: %s", error->message);
+            g_error_free (error);
+        }
+
+        DEBUG ("No active monitors, exiting in 30s");
+        watcher->shutdown_pending = TRUE;
+    }
+
+    g_application_release (G_APPLICATION (watcher));
+}
+
 static void
 watcher_startup (GApplication *application)
 {
@@ -583,15 +587,13 @@ watcher_startup (GApplication *application)
 
     add_name_listener (watcher);
 
-    if (xapp_status_icon_any_monitors ())
-    {
-        continue_startup (watcher);
-    }
-    else
-    {
-        DEBUG ("No active monitors, exiting in 30s");
-        watcher->shutdown_pending = TRUE;
-    }
+    g_application_hold (application);
+
+    watcher->monitors_watch_id = xapp_status_icon_watch_monitors (on_monitors_changed, watcher, NULL);
+
+    xapp_status_icon_any_monitors_async (watcher->cancellable,
+                                         on_startup_monitors_checked,
+                                         watcher);
 }
 
 static void
@@ -607,6 +609,12 @@ watcher_shutdown (GApplication *application)
 
     g_clear_object (&xapp_settings);
 
+    if (watcher->monitors_watch_id > 0)
+    {
+        xapp_status_icon_unwatch_monitors (watcher->monitors_watch_id);
+        watcher->monitors_watch_id = 0;
+    }
+
     if (watcher->name_listener_id > 0)
     {
         g_dbus_connection_signal_unsubscribe (watcher->connection, watcher->name_listener_id);